@@ -144,6 +144,29 @@ class BackingStore
 			throw IOException(TRACE_INFO, "Not implemented!");
 		}
 
+		/**
+		 * Store a batch of Atoms, as if by calling `storeAtom()` on
+		 * each, in order. Backends that can commit many writes in one
+		 * transaction (or one system call) should override this.
+		 */
+		virtual void storeAtoms(const HandleSeq& atoms)
+		{
+			for (const Handle& h : atoms)
+				storeAtom(h);
+		}
+
+		/**
+		 * Store a batch of (atom, key) Values, as if by calling
+		 * `storeValue()` on each, in order. As above, this should be
+		 * overridden by backends that can do better.
+		 */
+		virtual void storeValues(
+			const std::vector<std::pair<Handle, Handle>>& atom_keys)
+		{
+			for (const std::pair<Handle, Handle>& ak : atom_keys)
+				storeValue(ak.first, ak.second);
+		}
+
 		/**
 		 * Perform an atomic read-modify-write of the Value located at
 		 * `key` on `atom`.  The existing Value at that location is
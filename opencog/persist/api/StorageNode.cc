@@ -408,6 +408,25 @@ void StorageNode::store_value(const Handle& h, const Handle& key)
 	storeValue(h, key);
 }
 
+void StorageNode::store_atoms(const HandleSeq& atoms)
+{
+	if (_target_as->get_read_only())
+		throw RuntimeException(TRACE_INFO,
+			"Attempt to store to read-only target AtomSpace %s",
+			_target_as->to_string().c_str());
+
+	storeAtoms(atoms);
+}
+
+void StorageNode::store_values(
+	const std::vector<std::pair<Handle, Handle>>& atom_keys)
+{
+	if (_target_as->get_read_only())
+		throw RuntimeException(TRACE_INFO, "Read-only AtomSpace!");
+
+	storeValues(atom_keys);
+}
+
 void StorageNode::update_value(const Handle& h, const Handle& key,
                                const ValuePtr& delta)
 {
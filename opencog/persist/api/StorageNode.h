@@ -309,6 +309,14 @@ public:
 	 */
 	void store_value(const Handle& atom, const Handle& key);
 
+	/**
+	 * Batched versions of `store_atom()` and `store_value()`, above.
+	 * These give the backend a chance to write the whole batch at
+	 * once, e.g. in a single transaction.
+	 */
+	void store_atoms(const HandleSeq& atoms);
+	void store_values(const std::vector<std::pair<Handle, Handle>>&);
+
 	/**
 	 * Update the Value located at `key` on `atom` at the remote
 	 * server, incorporating a delta-change `delta`. This is an
@@ -18,6 +18,10 @@
 (load-extension (string-append opencog-ext-path-persist-proxy "libpersist-proxy")
 	"opencog_persist_proxy_init")
 
+; And the JsonStorageNode.
+(load-extension (string-append opencog-ext-path-persist-json "libpersist-json")
+	"opencog_persist_json_init")
+
 (include-from-path "opencog/persist/types/storage_types.scm")
 
 ;; Global. Maybe should be per-fluid? I dunno, this is for backwards
@@ -1170,6 +1174,45 @@
 	(PredicateNode "*-monitor-*")
 )
 
+(define-public (*-metrics-*)
+"
+  (PredicateNode \"*-metrics-*\") message
+
+    Return the performance metrics of a buffering proxy, as a
+    LinkValue holding a StringValue of metric names, and a FloatValue
+    of the matching numbers. The names are the same as in the
+    `*-prometheus-*` report. StorageNodes that do not keep metrics
+    return nothing.
+
+  Usage:
+    (cog-value STORAGE (*-metrics-*))
+
+    See also:
+       `*-monitor-*` for a human-readable report.
+       `*-prometheus-*` for the Prometheus text format.
+"
+	(PredicateNode "*-metrics-*")
+)
+
+(define-public (*-prometheus-*)
+"
+  (PredicateNode \"*-prometheus-*\") message
+
+    Return a StringValue holding the performance metrics of a
+    buffering proxy, in the Prometheus text exposition format. This
+    includes counters of the Atoms and Values written, the number of
+    stalls, the queue sizes, and histograms of batch write times and
+    of queue depth. Each series is labelled with the proxy name.
+
+  Usage:
+    (display (cog-value-ref STORAGE (*-prometheus-*) 0))
+
+    See also:
+       `*-metrics-*` for the same numbers as a Value.
+"
+	(PredicateNode "*-prometheus-*")
+)
+
 (define*-public (monitor-storage #:optional (STORAGE (cog-storage-node)))
 "
  monitor-storage [STORAGE]
@@ -1207,16 +1250,194 @@
   Specify a time interval to a buffering proxy.
   Conventionaly, the number is undertood to be seconds.
 
+  For the WriteBufferProxy, this is the latency target: buffered
+  writes should not wait much longer than this. The proxy measures
+  how long its targets take to write, and uses that to decide how
+  much to write at a time, and when to make writers wait. Longer
+  times give repeated writes of the same Atom or Value more of a
+  chance to be merged into one. The default is 60 seconds.
+
     Example:
        (define pxy (WriteBufferProxy \"buffy slayer\"))
        (cog-set-value! pxy (*-decay-const-*) (NumberNode 42))
 
     See also:
        `*-proxy-parts-*` to specify the components making up a proxy.
+       `*-drain-threads-*` to set the number of writers.
 "
 	(PredicateNode "*-decay-const-*")
 )
 
+(define-public (*-drain-threads-*)
+"
+  (PredicateNode \"*-drain-threads-*\") message
+
+  Specify the number of threads that a buffering proxy uses to write
+  to its targets. The default is one. Each buffered batch is split by
+  Atom, so that all writes for a given Atom are made by one thread,
+  in order. This helps only for targets that scale with concurrent
+  writers.
+
+    Example:
+       (define pxy (WriteBufferProxy \"buffy slayer\"))
+       (cog-set-value! pxy (*-drain-threads-*) (NumberNode 4))
+
+    See also:
+       `*-decay-const-*` to specify the buffering time interval.
+"
+	(PredicateNode "*-drain-threads-*")
+)
+
+(define-public (*-memory-budget-*)
+"
+  (PredicateNode \"*-memory-budget-*\") message
+
+  Specify the maximum number of bytes that a buffering proxy may hold
+  in its queues. The bytes held are estimated from the sizes of the
+  queued Atoms and Values. Writers stall when the budget is exceeded,
+  until the buffer has drained. Zero, the default, means no limit.
+
+    Example:
+       (define pxy (WriteBufferProxy \"buffy slayer\"))
+       (cog-set-value! pxy (*-memory-budget-*) (NumberNode 2e9))
+
+    See also:
+       `*-decay-const-*` to specify the buffering time interval.
+       `*-spill-file-*` to avoid stalling writers.
+"
+	(PredicateNode "*-memory-budget-*")
+)
+
+(define-public (*-spill-file-*)
+"
+  (PredicateNode \"*-spill-file-*\") message
+
+  Specify a file that a buffering proxy appends to, when its queues
+  are full, instead of making writers wait. The file is replayed, in
+  order, once the targets have caught up, and it is emptied after
+  that. Each append is synced to disk before the writer goes on, so
+  if the process crashes, whatever is in the file is written out when
+  the proxy is next opened. Errors writing the file are thrown back
+  to the writer. The file name is given as a
+  StringValue. This takes effect when the proxy is opened.
+
+    Example:
+       (define pxy (WriteBufferProxy \"buffy slayer\"))
+       (cog-set-value! pxy (*-spill-file-*)
+          (StringValue \"/var/tmp/buffy-spill.scm\"))
+       (cog-set-value! pxy (*-memory-budget-*) (NumberNode 2e9))
+
+    See also:
+       `*-memory-budget-*` to specify when the queues are full.
+"
+	(PredicateNode "*-spill-file-*")
+)
+
+(define-public (*-ordered-*)
+"
+  (PredicateNode \"*-ordered-*\") message
+
+  Ask a buffering proxy to write Atoms and Values in the same order
+  that they were stored, as needed by append-only targets, such as
+  the FileStorageNode. Storing the same Atom, or the same Value, a
+  second time moves it to the back of the line, so that it is still
+  written only once. Ordered writes are made by a single thread, and
+  Value deltas are not combined. Set to (NumberNode 1) to enable, and
+  to (NumberNode 0) to disable; this can only be done while the proxy
+  is closed.
+
+    Example:
+       (define pxy (WriteBufferProxy \"buffy slayer\"))
+       (cog-set-value! pxy (*-ordered-*) (NumberNode 1))
+
+    See also:
+       `*-drain-threads-*` for unordered, concurrent writes.
+"
+	(PredicateNode "*-ordered-*")
+)
+
+(define-public (*-cache-atoms-*)
+"
+  (PredicateNode \"*-cache-atoms-*\") message
+
+  Limit the number of Atoms that a CachingProxy keeps in the AtomSpace.
+  Atoms fetched through the proxy are tracked in least-recently-used
+  order; once there are more than the limit, the coldest are extracted
+  from the AtomSpace. They will be fetched again, if asked for. The
+  Atoms that come along with a fetch, such as outgoing sets, incoming
+  sets and query results, are tracked too. Atoms that still have an
+  incoming set are not extracted until the incoming set is; they stay
+  the coldest, and go as soon as they can. Set to (NumberNode 0) to
+  remove the limit; this is the default.
+
+    Example:
+       (define pxy (CachingProxy \"cache dash\"))
+       (cog-set-value! pxy (*-cache-atoms-*) (NumberNode 100000))
+
+    See also:
+       `*-cache-bytes-*` to limit the estimated RAM usage, instead.
+"
+	(PredicateNode "*-cache-atoms-*")
+)
+
+(define-public (*-cache-bytes-*)
+"
+  (PredicateNode \"*-cache-bytes-*\") message
+
+  Limit the estimated RAM used by the Atoms, and their Values, that a
+  CachingProxy keeps in the AtomSpace. The estimate is rough. This works
+  just like `*-cache-atoms-*`, and both limits can be set at once; the
+  cold Atoms are extracted when either limit is exceeded.
+
+    Example:
+       (define pxy (CachingProxy \"cache dash\"))
+       (cog-set-value! pxy (*-cache-bytes-*) (NumberNode 1e9))
+"
+	(PredicateNode "*-cache-bytes-*")
+)
+
+(define-public (*-cache-ttl-*)
+"
+  (PredicateNode \"*-cache-ttl-*\") message
+
+  Set how long, in seconds, a CachingProxy trusts the Values it has
+  fetched. Older Values are stale, and are fetched again the next time
+  they are asked for. A NumberNode sets the default, for all keys; a
+  LinkValue holding a key and a NumberNode sets it for just that key.
+  Values that were never fetched, such as those set locally, never go
+  stale. A TTL of zero means never stale; this is the default.
+
+    Example:
+       (define pxy (CachingProxy \"cache dash\"))
+       (cog-set-value! pxy (*-cache-ttl-*) (NumberNode 30))
+       (cog-set-value! pxy (*-cache-ttl-*)
+          (LinkValue (Predicate \"counts\") (NumberNode 2)))
+
+    See also:
+       `*-serve-stale-*` to refetch stale Values in the background.
+"
+	(PredicateNode "*-cache-ttl-*")
+)
+
+(define-public (*-serve-stale-*)
+"
+  (PredicateNode \"*-serve-stale-*\") message
+
+  Ask a CachingProxy to return stale Values at once, instead of waiting
+  for them to be fetched again. The fresh Values are fetched by a
+  background thread, and replace the stale ones when they arrive. Set
+  to (NumberNode 1) to enable, and to (NumberNode 0) to disable.
+
+    Example:
+       (define pxy (CachingProxy \"cache dash\"))
+       (cog-set-value! pxy (*-serve-stale-*) (NumberNode 1))
+
+    See also:
+       `*-cache-ttl-*` to say when Values go stale.
+"
+	(PredicateNode "*-serve-stale-*")
+)
+
 (define-public (*-proxy-open-*)
 "
   (PredicateNode \"*-proxy-open-*\") message
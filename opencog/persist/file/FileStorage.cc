@@ -39,6 +39,9 @@
 
 using namespace opencog;
 
+// Batches are written out in blocks of about this size.
+#define STORE_BLOCK (1024*1024)
+
 FileStorageNode::FileStorageNode(Type t, const std::string& uri)
 	: StorageNode(t, uri)
 {
@@ -158,9 +161,11 @@ void FileStorageNode::storeAtom(const Handle& h, bool synchronous)
 		throw IOException(TRACE_INFO,
 		"FileStorageNode %s is not open!", _filename.c_str());
 
-	const std::string sex = Sexpr::dump_atom(h);
-	fwrite(sex.c_str(), sex.length(), 1, _fh);
-	size_t rc = fwrite("\n", 1, 1, _fh);
+	// One write per line, so that lines from concurrent writers
+	// are not interleaved.
+	std::string sex = Sexpr::dump_atom(h);
+	sex.push_back('\n');
+	size_t rc = fwrite(sex.c_str(), sex.length(), 1, _fh);
 
 	if (1 != rc)
 		throw IOException(TRACE_INFO,
@@ -180,9 +185,9 @@ void FileStorageNode::storeValue(const Handle& h, const Handle& key)
 		throw IOException(TRACE_INFO,
 		"FileStorageNode %s is not open!", _filename.c_str());
 
-	const std::string sex = Sexpr::dump_vatom(h, key);
-	fwrite(sex.c_str(), sex.length(), 1, _fh);
-	size_t rc = fwrite("\n", 1, 1, _fh);
+	std::string sex = Sexpr::dump_vatom(h, key);
+	sex.push_back('\n');
+	size_t rc = fwrite(sex.c_str(), sex.length(), 1, _fh);
 
 	if (1 != rc)
 		throw IOException(TRACE_INFO,
@@ -190,6 +195,60 @@ void FileStorageNode::storeValue(const Handle& h, const Handle& key)
 			_filename.c_str(), strerror(errno));
 }
 
+// The Value has already been incremented in the AtomSpace; an
+// append-only log just records the result.
+void FileStorageNode::updateValue(const Handle& h, const Handle& key,
+                                  const ValuePtr&)
+{
+	storeValue(h, key);
+}
+
+// Write a block of lines with one fwrite(), and clear the buffer.
+void FileStorageNode::write_lines(std::string& buf)
+{
+	if (0 == buf.size()) return;
+	size_t rc = fwrite(buf.data(), buf.size(), 1, _fh);
+	buf.clear();
+
+	if (1 != rc)
+		throw IOException(TRACE_INFO,
+		"FileStorageNode failed to store Atoms at %s: %s",
+			_filename.c_str(), strerror(errno));
+}
+
+void FileStorageNode::storeAtoms(const HandleSeq& atoms)
+{
+	if (not connected())
+		throw IOException(TRACE_INFO,
+		"FileStorageNode %s is not open!", _filename.c_str());
+
+	std::string buf;
+	for (const Handle& h : atoms)
+	{
+		buf += Sexpr::dump_atom(h);
+		buf.push_back('\n');
+		if (STORE_BLOCK < buf.size()) write_lines(buf);
+	}
+	write_lines(buf);
+}
+
+void FileStorageNode::storeValues(
+	const std::vector<std::pair<Handle, Handle>>& atom_keys)
+{
+	if (not connected())
+		throw IOException(TRACE_INFO,
+		"FileStorageNode %s is not open!", _filename.c_str());
+
+	std::string buf;
+	for (const std::pair<Handle, Handle>& ak : atom_keys)
+	{
+		buf += Sexpr::dump_vatom(ak.first, ak.second);
+		buf.push_back('\n');
+		if (STORE_BLOCK < buf.size()) write_lines(buf);
+	}
+	write_lines(buf);
+}
+
 void FileStorageNode::loadValue(const Handle&, const Handle&)
 {
 	throw IOException(TRACE_INFO,
@@ -40,6 +40,8 @@ class FileStorageNode : public StorageNode
 		FILE* _fh;
 		bool _already_loaded;
 
+		void write_lines(std::string&);
+
 	public:
 		FileStorageNode(Type t, const std::string& uri);
 		virtual ~FileStorageNode();
@@ -61,6 +63,9 @@ class FileStorageNode : public StorageNode
 		void storeAtom(const Handle&, bool synchronous = false);
 		void removeAtom(AtomSpace*, const Handle&, bool recursive);
 		void storeValue(const Handle&, const Handle&);
+		void updateValue(const Handle&, const Handle&, const ValuePtr&);
+		void storeAtoms(const HandleSeq&);
+		void storeValues(const std::vector<std::pair<Handle, Handle>>&);
 		void loadValue(const Handle&, const Handle&);
 		void loadType(AtomSpace*, Type);
 		void barrier(AtomSpace* = nullptr);
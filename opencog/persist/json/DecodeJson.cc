@@ -20,15 +20,19 @@
  * Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#include <cmath>
+#include <cstring>
 #include <iomanip>
 
 #include <opencog/atoms/base/Atom.h>
 #include <opencog/atoms/base/Node.h>
 #include <opencog/atoms/base/Link.h>
+#include <opencog/atoms/value/BoolValue.h>
 #include <opencog/atoms/value/FloatValue.h>
 #include <opencog/atoms/value/LinkValue.h>
 #include <opencog/atoms/value/StringValue.h>
 #include <opencog/atoms/value/ValueFactory.h>
+#include <opencog/atoms/value/VoidValue.h>
 #include <opencog/atomspace/AtomSpace.h>
 
 #include "Json.h"
@@ -88,11 +92,37 @@ Type Json::decode_type(const std::string& tna, size_t& pos)
 
 /* ================================================================== */
 
+/// Same as above, but for a type name that has already been scanned
+/// onto a tape. The token may be a quoted string or a bare word.
+Type Json::decode_type(const std::string& s, const JsonTape& tape,
+                       size_t tok)
+{
+	if (JsonTape::npos == tok or JsonToken::OBJECT == tape[tok].kind or
+	    JsonToken::ARRAY == tape[tok].kind)
+		throw SyntaxException(TRACE_INFO, "Bad Type");
+
+	std::string tname;
+	if (JsonToken::STRING == tape[tok].kind)
+		tname = tape.get_raw(s, tok);
+	else
+		tname = s.substr(tape[tok].start, tape[tok].end - tape[tok].start);
+
+	Type t = nameserver().getType(tname);
+	if (NOTYPE == t)
+		throw SyntaxException(TRACE_INFO, "Unknown Type >>%s<<",
+			tname.c_str());
+	return t;
+}
+
+/* ================================================================== */
+
 /**
  * Decode a type argument that can be either a simple string like
  * "ConceptNode" or a JSON object like {"type": "ConceptNode"}.
  * It might also be a field in a JSON object:
  *   {"other": "stuff", "type": "ConceptNode", "more": "stuff"}
+ * Only a top-level "type" field counts; the "type" of some nested
+ * object does not.
  */
 Type Json::decode_type_arg(const std::string& tna, size_t& pos)
 {
@@ -101,69 +131,24 @@ Type Json::decode_type_arg(const std::string& tna, size_t& pos)
 	if (std::string::npos == pos)
 		throw SyntaxException(TRACE_INFO, "Bad Type - empty string");
 
-	// Check if this is a JSON object format
-	if ('{' == tna[pos])
-	{
-		// Save the start position of the JSON object
-		size_t obj_start = pos;
-
-		// Look for "type": field
-		size_t tpos = tna.find("\"type\":", pos);
-		if (std::string::npos == tpos)
-			throw SyntaxException(TRACE_INFO, "Missing type field in JSON object");
-
-		tpos += 7; // skip past "type":
-
-		// Call the original decode_type to parse the actual type name
-		Type t = decode_type(tna, tpos);
-
-		// For MCP format, we're looking at a params object that might have
-		// other fields before "type". We need to find the closing brace
-		// of the entire params object, not just the first closing brace.
-		// We'll count braces but also handle string literals properly.
-		size_t scan_pos = obj_start;
-		int brace_count = 0;
-		size_t close = std::string::npos;
-		bool in_string = false;
-		bool escape_next = false;
-
-		while (scan_pos < tna.size()) {
-			char ch = tna[scan_pos];
-
-			if (escape_next) {
-				escape_next = false;
-			} else if (ch == '\\' && in_string) {
-				escape_next = true;
-			} else if (ch == '"') {
-				in_string = !in_string;
-			} else if (!in_string) {
-				if (ch == '{') {
-					brace_count++;
-				} else if (ch == '}') {
-					brace_count--;
-					if (brace_count == 0) {
-						close = scan_pos;
-						break;
-					}
-				}
-			}
-			scan_pos++;
-		}
+	// Simple string format - just call decode_type directly
+	if ('{' != tna[pos])
+		return decode_type(tna, pos);
 
-		if (std::string::npos == close)
-			throw SyntaxException(TRACE_INFO, "Missing closing brace >>%s<<",
-				tna.substr(obj_start).c_str());
+	JsonTape tape;
+	if (not tape.scan(tna, pos))
+		throw SyntaxException(TRACE_INFO, "Bad JSON object: %s >>%s<<",
+			tape.error().c_str(), tna.substr(pos).c_str());
 
-		// Update pos to point after the closing brace.
-		pos = close + 1;
+	size_t tpos = tape.field(tna, 0, "type");
+	if (JsonTape::npos == tpos)
+		throw SyntaxException(TRACE_INFO, "Missing type field in JSON object");
 
-		return t;
-	}
-	else
-	{
-		// Simple string format - just call decode_type directly
-		return decode_type(tna, pos);
-	}
+	Type t = decode_type(tna, tape, tpos);
+
+	// Update pos to point after the closing brace.
+	pos = tape[0].end;
+	return t;
 }
 
 /* ================================================================== */
@@ -213,131 +198,22 @@ std::string Json::get_node_name_arg(const std::string& s, size_t& pos, size_t& r
 	if (std::string::npos == pos)
 		throw SyntaxException(TRACE_INFO, "Bad node name - empty string");
 
-	// Check if this is a JSON object format
-	if ('{' == s[pos])
-	{
-		// Look for "name": field
-		size_t npos = s.find("\"name\":", pos);
-		if (std::string::npos == npos)
-			throw SyntaxException(TRACE_INFO, "Missing name field in JSON object");
-
-		npos += 7; // skip past "name":
-
-		// Find the closing brace to use as boundary
-		size_t close = s.find('}', npos);
-		if (std::string::npos == close)
-			throw SyntaxException(TRACE_INFO, "Missing closing brace >>%s<<",
-				s.substr(npos).c_str());
-
-		// Call get_node_name to extract the actual name
-		std::string name = get_node_name(s, npos, close);
-
-		// Update pos to point after the closing brace
-		pos = close + 1;
-
-		return name;
-	}
-	else
-	{
-		// Simple string format - just call get_node_name directly
+	// Simple string format - just call get_node_name directly
+	if ('{' != s[pos])
 		return get_node_name(s, pos, r);
-	}
-}
 
-/* ================================================================== */
-
-/// Helper function to find the closing delimiter of a JSON object or array
-/// For objects (starting with '{'), returns the position after the closing '}'
-/// For arrays (starting with '['), returns the position after the closing ']'
-/// Returns string::npos if not found or if start doesn't begin with '{' or '['
-static size_t find_json_end(const std::string& s, size_t start)
-{
-	if (start >= s.size()) return std::string::npos;
-
-	char open_char = s[start];
-
-	if (open_char != '{' && open_char != '[') {
-		return std::string::npos;
-	}
-
-	int depth = 1;
-	size_t pos = start + 1;
-	bool in_string = false;
-	bool escape_next = false;
-
-	while (pos < s.size() && depth > 0) {
-		char ch = s[pos];
-		if (escape_next) {
-			escape_next = false;
-		} else if (ch == '\\' && in_string) {
-			escape_next = true;
-		} else if (ch == '"') {
-			in_string = !in_string;
-		} else if (!in_string) {
-			if (ch == open_char) {
-				// Only count the same type of delimiter we're looking for
-				depth++;
-			} else if ((open_char == '{' && ch == '}') ||
-			           (open_char == '[' && ch == ']')) {
-				depth--;
-				if (depth == 0) {
-					// Found the matching closing delimiter
-					return pos + 1; // Return position after the delimiter
-				}
-			}
-		}
-		pos++;
-	}
-
-	return (depth == 0) ? pos : std::string::npos;
-}
+	JsonTape tape;
+	if (not tape.scan(s, pos))
+		throw SyntaxException(TRACE_INFO, "Bad JSON object: %s >>%s<<",
+			tape.error().c_str(), s.substr(pos).c_str());
 
-/// Helper function to find a top-level field in a JSON object
-/// Returns the position after the colon, or string::npos if not found
-static size_t find_top_level_field(const std::string& s,
-                                   const std::string& field_name,
-                                   size_t obj_start, size_t obj_end)
-{
-	std::string search_pattern = "\"" + field_name + "\":";
-	size_t search_pos = obj_start + 1;
-	int depth = 0;
-	bool in_string = false;
-	bool escape_next = false;
-
-	while (search_pos < obj_end) {
-		char ch = s[search_pos];
-		if (escape_next) {
-			escape_next = false;
-		} else if (ch == '\\' && in_string) {
-			escape_next = true;
-		} else if (ch == '"') {
-			in_string = !in_string;
-			// When we exit a string at depth 0, check if it's our field
-			if (!in_string && depth == 0) {
-				// We just exited a string, check if it matches our pattern
-				// Make sure we have enough characters before search_pos
-				// We need at least field_name.length() + 2 chars (for quotes) before search_pos
-				if (search_pos >= field_name.length() + 2) {
-					size_t check_start = search_pos - field_name.length() - 1;
-					// Additional bounds check
-					if (check_start >= obj_start &&
-					    check_start + search_pattern.length() <= s.length() &&
-					    s.compare(check_start, search_pattern.length(), search_pattern) == 0) {
-						return check_start + search_pattern.length();
-					}
-				}
-			}
-		} else if (!in_string) {
-			if (ch == '{' || ch == '[') {
-				depth++;
-			} else if (ch == '}' || ch == ']') {
-				depth--;
-			}
-		}
-		search_pos++;
-	}
+	size_t fpos = tape.field(s, 0, "name");
+	if (JsonTape::npos == fpos or JsonToken::STRING != tape[fpos].kind)
+		throw SyntaxException(TRACE_INFO, "Missing name field in JSON object");
 
-	return std::string::npos;
+	// Update pos to point after the closing brace
+	pos = tape[0].end;
+	return tape.get_string(s, fpos);
 }
 
 /* ================================================================== */
@@ -349,7 +225,8 @@ static size_t find_top_level_field(const std::string& s,
 /// should also work.
 ///
 /// The string to decode is `s`, beginning at location `l` and using `r`
-/// as a hint for the end of the expression.
+/// as a hint for the end of the expression. On success, `r` is set to
+/// point just past the closing brace.
 ///
 Handle Json::decode_atom(const std::string& s,
                          size_t& l, size_t& r)
@@ -359,42 +236,37 @@ Handle Json::decode_atom(const std::string& s,
 	if (std::string::npos == l or s[l] != '{')
 		return Handle::UNDEFINED;
 
-	// Find the end of this JSON object
-	size_t obj_start = l;
-	size_t obj_end = find_json_end(s, obj_start);
-	if (std::string::npos == obj_end) return Handle::UNDEFINED;
+	JsonTape tape;
+	if (not tape.scan(s, l)) return Handle::UNDEFINED;
+
+	Handle h = decode_atom(s, tape, 0);
+	if (h) r = tape[0].end;
+	return h;
+}
+
+/// Same as above, but for an object that has already been scanned
+/// onto a tape. The `tok` is the tape index of the object.
+Handle Json::decode_atom(const std::string& s, const JsonTape& tape,
+                         size_t tok)
+{
+	if (JsonTape::npos == tok or JsonToken::OBJECT != tape[tok].kind)
+		return Handle::UNDEFINED;
 
 	// Check for "atomese" field - if present, decode as s-expression
-	size_t apos = find_top_level_field(s, "atomese", obj_start, obj_end);
-	if (std::string::npos != apos)
+	size_t apos = tape.field(s, tok, "atomese");
+	if (JsonTape::npos != apos)
 	{
-		// Find the start of the string value
-		apos = s.find_first_not_of(" \n\t", apos);
-		if (std::string::npos == apos or '"' != s[apos])
+		if (JsonToken::STRING != tape[apos].kind)
 			return Handle::UNDEFINED;
 
-		// Extract the quoted string and unescape it
-		std::stringstream ss;
-		ss << s.substr(apos);
-		std::string sexpr_str;
-		ss >> std::quoted(sexpr_str);
-
-		// Decode using s-expression decoder
+		std::string sexpr_str = tape.get_string(s, apos);
 		size_t sexpr_pos = 0;
-		Handle h = Sexpr::decode_atom(sexpr_str, sexpr_pos);
-
-		// Update r to point after the closing brace of the JSON object
-		r = obj_end;
-		return h;
+		return Sexpr::decode_atom(sexpr_str, sexpr_pos);
 	}
 
-	// Find the "type" field at the top level
-	size_t tpos = find_top_level_field(s, "type", obj_start, obj_end);
-	if (std::string::npos == tpos) return Handle::UNDEFINED;
-
 	Type t = NOTYPE;
 	try {
-		t = Json::decode_type(s, tpos);
+		t = Json::decode_type(s, tape, tape.field(s, tok, "type"));
 	}
 	catch(...) {
 		return Handle::UNDEFINED;
@@ -402,239 +274,248 @@ Handle Json::decode_atom(const std::string& s,
 
 	if (nameserver().isA(t, NODE))
 	{
-		// Find the "name" field at the top level
-		size_t apos = find_top_level_field(s, "name", obj_start, obj_end);
-		if (std::string::npos == apos) return Handle::UNDEFINED;
-
-		apos = s.find_first_not_of(" \n\t", apos);
-		size_t name_end = obj_end;
-		std::string name = Json::get_node_name(s, apos, name_end);
-
-		// Update r to point after the closing brace of the JSON object
-		r = obj_end;
+		size_t fpos = tape.field(s, tok, "name");
+		if (JsonTape::npos == fpos or JsonToken::STRING != tape[fpos].kind)
+			return Handle::UNDEFINED;
 
-		return createNode(t, std::move(name));
+		return createNode(t, tape.get_string(s, fpos));
 	}
 
 	if (nameserver().isA(t, LINK))
 	{
-		// Find the "outgoing" field at the top level
-		size_t opos = find_top_level_field(s, "outgoing", obj_start, obj_end);
-		if (std::string::npos == opos) return Handle::UNDEFINED;
+		size_t opos = tape.field(s, tok, "outgoing");
+		if (JsonTape::npos == opos or JsonToken::ARRAY != tape[opos].kind)
+			return Handle::UNDEFINED;
+
+		HandleSeq hs;
+		for (size_t i = tape.begin(opos); i < tape.end(opos); i = tape[i].next)
+		{
+			Handle ho = Json::decode_atom(s, tape, i);
+			if (nullptr == ho) return Handle::UNDEFINED;
+			hs.push_back(ho);
+		}
 
-		// Find the opening bracket of the outgoing array
-		l = s.find("[", opos);
-		if (std::string::npos == l) return Handle::UNDEFINED;
+		return createLink(std::move(hs), t);
+	}
 
-		// Find the closing bracket using our helper function
-		size_t array_end = find_json_end(s, l);
-		if (std::string::npos == array_end) return Handle::UNDEFINED;
+	return Handle::UNDEFINED;
+}
 
-		l++; // Move past the '['
-		size_t close_bracket = array_end - 1; // Position of the ']'
+/* ================================================================== */
 
-		HandleSeq hs;
+static inline int b64_value(char c)
+{
+	if ('A' <= c and c <= 'Z') return c - 'A';
+	if ('a' <= c and c <= 'z') return c - 'a' + 26;
+	if ('0' <= c and c <= '9') return c - '0' + 52;
+	if ('+' == c) return 62;
+	if ('/' == c) return 63;
+	return -1;
+}
 
-		// Process each atom in the outgoing array
-		while (l < close_bracket)
+/// Decode the base64 text in `s` from `beg` up to `end`, appending
+/// the bytes to `out`. The padding is optional. Returns false if the
+/// text is not base64.
+bool Json::decode_base64(const std::string& s, size_t beg, size_t end,
+                         std::string& out)
+{
+	out.reserve(out.size() + 3 * ((end - beg) / 4) + 2);
+
+	uint32_t w = 0;
+	int n = 0;
+	bool pad = false;
+	for (size_t i = beg; i < end; i++)
+	{
+		char c = s[i];
+
+		// JSON allows the slash to be escaped.
+		if ('\\' == c and i+1 < end and '/' == s[i+1]) continue;
+		if ('=' == c) { pad = true; continue; }
+
+		int v = b64_value(c);
+		if (v < 0 or pad) return false;
+		w = (w << 6) | v;
+		if (4 == ++n)
 		{
-			// Skip whitespace and commas
-			l = s.find_first_not_of(" \n\t,", l);
-			if (l >= close_bracket || std::string::npos == l) break;
+			out.push_back((char) (w >> 16));
+			out.push_back((char) (w >> 8));
+			out.push_back((char) w);
+			w = 0;
+			n = 0;
+		}
+	}
 
-			// Check if we've reached the end of the array
-			if (s[l] == ']') break;
+	if (1 == n) return false;
+	if (2 == n) out.push_back((char) (w >> 4));
+	if (3 == n)
+	{
+		out.push_back((char) (w >> 10));
+		out.push_back((char) (w >> 2));
+	}
+	return true;
+}
 
-			size_t atom_end = close_bracket;
-			Handle ho = Json::decode_atom(s, l, atom_end);
-			if (nullptr == ho) return Handle::UNDEFINED;
-			hs.push_back(ho);
+/// Decode `{"type":"FloatValue","b64":"..."}` and
+/// `{"type":"BoolValue","size":9,"b64":"..."}`. See `Json.h`.
+static ValuePtr decode_b64(const std::string& s, const JsonTape& tape,
+                           size_t tok, size_t bpos, Type t)
+{
+	if (JsonToken::STRING != tape[bpos].kind) return nullptr;
 
-			// Update position for next iteration
-			l = atom_end;
+	std::string raw;
+	if (not Json::decode_base64(s, tape[bpos].start + 1,
+	                            tape[bpos].end - 1, raw))
+		return nullptr;
+
+	if (nameserver().isA(t, FLOAT_VALUE))
+	{
+		if (0 != raw.size() % sizeof(double)) return nullptr;
+		size_t cnt = raw.size() / sizeof(double);
+		std::vector<double> vd(cnt);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		memcpy(vd.data(), raw.data(), raw.size());
+#else
+		for (size_t j = 0; j < cnt; j++)
+		{
+			uint64_t u = 0;
+			for (int i = 0; i < 8; i++)
+				u |= ((uint64_t) (uint8_t) raw[8*j + i]) << (8*i);
+			memcpy(&vd[j], &u, sizeof(u));
 		}
+#endif
+		return valueserver().create(t, std::move(vd));
+	}
 
-		// Update r to point after the closing brace of the JSON object
-		r = obj_end;
+	if (nameserver().isA(t, BOOL_VALUE))
+	{
+		// Without a size, all of the bits in the last byte count.
+		size_t nbits = 8 * raw.size();
+		size_t spos = tape.field(s, tok, "size");
+		if (JsonTape::npos != spos)
+		{
+			double d;
+			try { d = tape.get_double(s, spos); }
+			catch (...) { return nullptr; }
+			if (d < 0.0 or nbits < d or d + 8 <= nbits or std::floor(d) != d)
+				return nullptr;
+			nbits = (size_t) d;
+		}
 
-		return createLink(std::move(hs), t);
+		std::vector<bool> vb(nbits);
+		for (size_t i = 0; i < nbits; i++)
+			vb[i] = (((uint8_t) raw[i/8]) >> (i%8)) & 1;
+		return valueserver().create(t, std::move(vb));
 	}
 
-	return Handle::UNDEFINED;
+	return nullptr;
 }
 
 /* ================================================================== */
 
-#define GET_VALUE_POS \
-	size_t opos = s.find("\"value\":", l); \
-	if (std::string::npos != opos) \
-		opos += 8;  /* skip past "value": */ \
-	else { \
-		opos = s.find("\"values\":", l); \
-		if (std::string::npos == opos) return nullptr; \
-		opos += 9;  /* skip past "values": */ \
-	}
-
 /// Convert an Atomese JSON expression into a C++ Value.
 /// For example: `{ "type": "FloatValue", "value": [1, 2, 3] }`
 /// will return the corresponding ValuePtr.
 ///
 /// The string to decode is `s`, beginning at location `l` and using `r`
-/// as a hint for the end of the expression.
+/// as a hint for the end of the expression. On success, `r` is set to
+/// point just past the closing brace.
 ///
 ValuePtr Json::decode_value(const std::string& s,
                             size_t& lo, size_t& ro)
 {
-	size_t l = lo;
-	l = s.find("{", l);
+	size_t l = s.find("{", lo);
 	if (std::string::npos == l) return nullptr;
 
-	// Find the end of this JSON object
-	size_t obj_start = l;
-	size_t obj_end = find_json_end(s, obj_start);
-	if (std::string::npos == obj_end) return nullptr;
+	JsonTape tape;
+	if (not tape.scan(s, l)) return nullptr;
+
+	ValuePtr v = decode_value(s, tape, 0);
+	if (v) ro = tape[0].end;
+	return v;
+}
+
+/// Same as above, but for an object that has already been scanned
+/// onto a tape. The `tok` is the tape index of the object.
+ValuePtr Json::decode_value(const std::string& s, const JsonTape& tape,
+                            size_t tok)
+{
+	if (JsonTape::npos == tok or JsonToken::OBJECT != tape[tok].kind)
+		return nullptr;
 
 	// Look for tunneled s-expressions
-	size_t apos = find_top_level_field(s, "atomese", obj_start, obj_end);
-	if (std::string::npos != apos)
+	size_t apos = tape.field(s, tok, "atomese");
+	if (JsonTape::npos != apos)
 	{
-		// Find the start of the string value
-		apos = s.find_first_not_of(" \n\t", apos);
-		if (std::string::npos == apos or '"' != s[apos])
+		if (JsonToken::STRING != tape[apos].kind)
 			return nullptr;
 
-		// Extract the quoted string and unescape it
-		std::stringstream ss;
-		ss << s.substr(apos);
-		std::string sexpr_str;
-		ss >> std::quoted(sexpr_str);
-
-		// Decode using s-expression decoder
+		std::string sexpr_str = tape.get_string(s, apos);
 		size_t sexpr_pos = 0;
-		ValuePtr v = Sexpr::decode_value(sexpr_str, sexpr_pos);
-
-		// Update ro to point after the closing brace of the JSON object
-		ro = obj_end;
-		return v;
+		return Sexpr::decode_value(sexpr_str, sexpr_pos);
 	}
 
-	size_t tpos = s.find("\"type\":", l);
-	if (std::string::npos == tpos) return nullptr;
-	tpos += 7;  // skip past "type":
-
 	Type t = NOTYPE;
 	try {
-		t = Json::decode_type(s, tpos);
+		t = Json::decode_type(s, tape, tape.field(s, tok, "type"));
 	}
 	catch(...) {
 		return nullptr;
 	}
 
 	if (nameserver().isA(t, ATOM))
-	{
-		return decode_atom(s, lo, ro);
-	}
+		return decode_atom(s, tape, tok);
 
-	if (nameserver().isA(t, FLOAT_VALUE))
-	{
-		l = tpos;
-		GET_VALUE_POS;
-		l = s.find("[", opos);
+	size_t bpos = tape.field(s, tok, "b64");
+	if (JsonTape::npos != bpos)
+		return decode_b64(s, tape, tok, bpos, t);
 
-		size_t r = ro;
-		std::vector<double> vd;
-		while (std::string::npos != l)
-		{
-			l++;
-			r = s.find_first_of(",]", l);
-			if (std::string::npos == r) break;
+	// There's nothing in a VoidValue; ignore whatever came with it.
+	if (nameserver().isA(t, VOID_VALUE))
+		return createVoidValue();
 
-			// Bad clients can (and do) send mal-formed JSON.
-			// This includes the empty list [] and expressions
-			// with a trailing comma. Skip out of those.
-			if (r == l) break;
+	size_t vpos = tape.field(s, tok, "value");
+	if (JsonTape::npos == vpos)
+		vpos = tape.field(s, tok, "values");
+	if (JsonTape::npos == vpos or JsonToken::ARRAY != tape[vpos].kind)
+		return nullptr;
 
-			std::stringstream ss;
-			ss << s.substr(l, r-l);
-			double d;
-			ss >> d;
-			vd.push_back(d);
+	size_t beg = tape.begin(vpos);
+	size_t end = tape.end(vpos);
 
-			if (']' == s[r]) break;
-			l = r;
+	if (nameserver().isA(t, FLOAT_VALUE))
+	{
+		std::vector<double> vd;
+		vd.reserve(end - beg);
+		try {
+			for (size_t i = beg; i < end; i = tape[i].next)
+				vd.push_back(tape.get_double(s, i));
+		}
+		catch(...) {
+			return nullptr;
 		}
-
-		r = s.find("}", r);
-		ro = r;
 		return valueserver().create(t, std::move(vd));
 	}
 
 	if (nameserver().isA(t, STRING_VALUE))
 	{
-		l = tpos;
-		GET_VALUE_POS;
-		l = s.find("[", opos);
-
-		size_t r = ro;
 		std::vector<std::string> vs;
-		while (std::string::npos != l)
+		for (size_t i = beg; i < end; i = tape[i].next)
 		{
-			l++;
-
-			// Bad clients can (and do) send mal-formed JSON.
-			// This includes the empty list [] and expressions
-			// with a trailing comma. Skip out of those.
-			if (']' == s[l]) break;
-
-			std::stringstream ss;
-			ss << s.substr(l);
-			std::string uq;
-			ss >> std::quoted(uq);
-			vs.push_back(uq);
-
-			// Step past the closing quote.
-			r = l + uq.size() + 2;
-
-			// Get to the next elt
-			r = s.find_first_of(",]", r);
-			if (std::string::npos == r) break;
-			if (']' == s[r]) break;
-			l = r;
+			if (JsonToken::STRING != tape[i].kind) return nullptr;
+			vs.emplace_back(tape.get_string(s, i));
 		}
-
-		r = s.find("}", r);
-		ro = r;
 		return valueserver().create(t, std::move(vs));
 	}
 
 	if (nameserver().isA(t, LINK_VALUE))
 	{
-		l = tpos;
-		GET_VALUE_POS;
-		l = s.find("[", opos);
-
-		size_t r = ro;
 		std::vector<ValuePtr> vv;
-		while (std::string::npos != l)
+		for (size_t i = beg; i < end; i = tape[i].next)
 		{
-			l++;
-			ValuePtr vp = decode_value(s, l, r);
-
-			// Bad clients can (and do) send mal-formed JSON.
-			// This includes the empty list [] and expressions
-			// with a trailing comma. Skip out of those.
-			if (nullptr == vp) break;
+			ValuePtr vp = decode_value(s, tape, i);
+			if (nullptr == vp) return nullptr;
 			vv.push_back(vp);
-
-			// Get to the next elt
-			r = s.find_first_of(",]", r);
-			if (std::string::npos == r) break;
-			if (']' == s[r]) break;
-			l = r;
 		}
-
-		r = s.find("}", r);
-		ro = r;
 		return valueserver().create(t, std::move(vv));
 	}
 
@@ -20,9 +20,14 @@
  * Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <iomanip>
 
 #include <opencog/atoms/base/Atom.h>
+#include <opencog/atoms/value/BoolValue.h>
 #include <opencog/atoms/value/FloatValue.h>
 #include <opencog/atoms/value/LinkValue.h>
 #include <opencog/atoms/value/StringValue.h>
@@ -100,15 +105,15 @@ std::string Json::encode_value(const ValuePtr& v, const std::string& indent)
 	Type typ = v->get_type();
 	if (nameserver().isA(typ, FLOAT_VALUE))
 	{
-		// The FloatValue to_string() method prints out
-		// plenty of digits, enough for high-precision.
+		// Print the shortest string that reads back as the same
+		// double; std::to_string() prints six fixed decimals.
 		FloatValuePtr fv(FloatValueCast(v));
 		const std::vector<double>& fl = fv->value();
 		bool first = true;
 		for (double d : fl)
 		{
 			if (not first) txt += ", ";
-			txt += std::to_string(d);
+			append_double(txt, d);
 			first = false;
 		}
 	}
@@ -206,4 +211,364 @@ std::string Json::encode_type_list(const std::vector<Type>& tlist)
 	return rv;
 }
 
+/* ================================================================== */
+// Compact encoders.
+//
+// These print no whitespace at all, and append to a single output
+// buffer, instead of building up and concatenating many small strings.
+// If `embed` is set, then the output is escaped, so that it can be
+// placed directly inside of a JSON string. This is what the MCP
+// replies need: the result is a JSON string that holds JSON. Escaping
+// as it is printed avoids printing, and then quoting a second time.
+
+// A structural quote; escaped if embedded.
+static inline void put_quote(std::string& out, bool embed)
+{
+	if (embed) out += "\\\"";
+	else out.push_back('"');
+}
+
+/// Shortest representation that round-trips. JSON has no way of
+/// writing NaN or infinity, and a bare `NaN` is not valid JSON; so
+/// these are written as the strings "NaN", "Infinity" and "-Infinity",
+/// which `JsonTape::get_double()` accepts.
+void Json::append_double(std::string& out, double d, bool embed)
+{
+	if (not std::isfinite(d))
+	{
+		put_quote(out, embed);
+		if (std::isnan(d)) out += "NaN";
+		else out += (0 < d) ? "Infinity" : "-Infinity";
+		put_quote(out, embed);
+		return;
+	}
+
+	char buf[32];
+	auto r = std::to_chars(buf, buf + sizeof(buf), d);
+	out.append(buf, r.ptr - buf);
+}
+
+// Append one already-escaped character sequence, escaping it again
+// if embedded.
+static inline void put_esc(std::string& out, char c, bool embed)
+{
+	out.push_back('\\');
+	if (embed)
+	{
+		out.push_back('\\');
+		if ('"' == c or '\\' == c) out.push_back('\\');
+	}
+	out.push_back(c);
+}
+
+void Json::append_quoted(std::string& out, const std::string& str, bool embed)
+{
+	put_quote(out, embed);
+
+	// Copy runs of plain characters in one go.
+	size_t run = 0;
+	size_t len = str.size();
+	for (size_t i = 0; i < len; i++)
+	{
+		unsigned char c = str[i];
+		if ('"' != c and '\\' != c and 0x20 <= c) continue;
+
+		out.append(str, run, i - run);
+		run = i + 1;
+		switch (c)
+		{
+			case '"': put_esc(out, '"', embed); break;
+			case '\\': put_esc(out, '\\', embed); break;
+			case '\n': put_esc(out, 'n', embed); break;
+			case '\r': put_esc(out, 'r', embed); break;
+			case '\t': put_esc(out, 't', embed); break;
+			case '\b': put_esc(out, 'b', embed); break;
+			case '\f': put_esc(out, 'f', embed); break;
+			default:
+			{
+				char hex[8];
+				snprintf(hex, sizeof(hex), "u%04x", c);
+				put_esc(out, hex[0], embed);
+				out.append(hex + 1, 4);
+			}
+		}
+	}
+	out.append(str, run, len - run);
+
+	put_quote(out, embed);
+}
+
+// Type names never need escaping.
+static inline void put_type(std::string& out, Type t, bool embed)
+{
+	put_quote(out, embed);
+	out += "type";
+	put_quote(out, embed);
+	out.push_back(':');
+	put_quote(out, embed);
+	out += nameserver().getTypeName(t);
+	put_quote(out, embed);
+}
+
+static inline void put_key(std::string& out, const char* key, bool embed)
+{
+	out.push_back(',');
+	put_quote(out, embed);
+	out += key;
+	put_quote(out, embed);
+	out.push_back(':');
+}
+
+void Json::encode_atom(std::string& out, const Handle& h, bool embed)
+{
+	out.push_back('{');
+	put_type(out, h->get_type(), embed);
+	if (h->is_node())
+	{
+		put_key(out, "name", embed);
+		append_quoted(out, h->get_name(), embed);
+		out.push_back('}');
+		return;
+	}
+
+	put_key(out, "outgoing", embed);
+	out.push_back('[');
+	bool first = true;
+	for (const Handle& ho : h->getOutgoingSet())
+	{
+		if (not first) out.push_back(',');
+		first = false;
+		encode_atom(out, ho, embed);
+	}
+	out += "]}";
+}
+
+static const char b64_chars[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/// Standard base64, with padding. None of the characters need to be
+/// escaped in JSON, so this works the same whether embedded, or not.
+void Json::append_base64(std::string& out, const char* buf, size_t len)
+{
+	const uint8_t* p = (const uint8_t*) buf;
+	out.reserve(out.size() + 4 * ((len + 2) / 3));
+
+	size_t i = 0;
+	for (; i + 2 < len; i += 3)
+	{
+		uint32_t w = (p[i] << 16) | (p[i+1] << 8) | p[i+2];
+		out.push_back(b64_chars[(w >> 18) & 0x3f]);
+		out.push_back(b64_chars[(w >> 12) & 0x3f]);
+		out.push_back(b64_chars[(w >> 6) & 0x3f]);
+		out.push_back(b64_chars[w & 0x3f]);
+	}
+	if (i + 1 == len)
+	{
+		uint32_t w = p[i] << 16;
+		out.push_back(b64_chars[(w >> 18) & 0x3f]);
+		out.push_back(b64_chars[(w >> 12) & 0x3f]);
+		out += "==";
+	}
+	else if (i + 2 == len)
+	{
+		uint32_t w = (p[i] << 16) | (p[i+1] << 8);
+		out.push_back(b64_chars[(w >> 18) & 0x3f]);
+		out.push_back(b64_chars[(w >> 12) & 0x3f]);
+		out.push_back(b64_chars[(w >> 6) & 0x3f]);
+		out.push_back('=');
+	}
+}
+
+// The b64 forms of FloatValue and BoolValue. The byte order and the
+// bit order are the same as in the binary s-expression protocol.
+static void encode_b64(std::string& out, const ValuePtr& v, bool embed)
+{
+	Type typ = v->get_type();
+	out.push_back('{');
+	put_type(out, typ, embed);
+
+	std::string raw;
+	if (nameserver().isA(typ, FLOAT_VALUE))
+	{
+		const std::vector<double>& fl = FloatValueCast(v)->value();
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		raw.assign((const char*) fl.data(), fl.size() * sizeof(double));
+#else
+		raw.reserve(fl.size() * sizeof(double));
+		for (double d : fl)
+		{
+			uint64_t u;
+			memcpy(&u, &d, sizeof(u));
+			for (int i = 0; i < 8; i++)
+				raw.push_back((char) (u >> (8*i)));
+		}
+#endif
+	}
+	else
+	{
+		BoolValuePtr bv(BoolValueCast(v));
+		size_t nbits = bv->size();
+		put_key(out, "size", embed);
+		out += std::to_string(nbits);
+
+		raw.assign((nbits + 7) / 8, 0);
+		for (size_t i = 0; i < nbits; i++)
+			if (bv->get_bit(i)) raw[i/8] |= (char) (1 << (i%8));
+	}
+
+	put_key(out, "b64", embed);
+	put_quote(out, embed);
+	Json::append_base64(out, raw.data(), raw.size());
+	put_quote(out, embed);
+	out.push_back('}');
+}
+
+void Json::encode_value(std::string& out, const ValuePtr& v,
+                        bool embed, bool b64)
+{
+	// Empty values are used to erase keys from atoms.
+	if (nullptr == v) { out += "false"; return; }
+
+	if (v->is_atom())
+	{
+		encode_atom(out, HandleCast(v), embed);
+		return;
+	}
+
+	Type typ = v->get_type();
+	if (b64 and (nameserver().isA(typ, FLOAT_VALUE) or
+	             nameserver().isA(typ, BOOL_VALUE)))
+	{
+		encode_b64(out, v, embed);
+		return;
+	}
+
+	out.push_back('{');
+	put_type(out, typ, embed);
+	put_key(out, "value", embed);
+	out.push_back('[');
+
+	if (nameserver().isA(typ, FLOAT_VALUE))
+	{
+		const std::vector<double>& fl = FloatValueCast(v)->value();
+		bool first = true;
+		for (double d : fl)
+		{
+			if (not first) out.push_back(',');
+			first = false;
+			append_double(out, d, embed);
+		}
+	}
+	else if (nameserver().isA(typ, STRING_VALUE))
+	{
+		const std::vector<std::string>& sl = StringValueCast(v)->value();
+		bool first = true;
+		for (const std::string& s : sl)
+		{
+			if (not first) out.push_back(',');
+			first = false;
+			append_quoted(out, s, embed);
+		}
+	}
+	else if (nameserver().isA(typ, LINK_VALUE))
+	{
+		const std::vector<ValuePtr>& ll = LinkValueCast(v)->value();
+		bool first = true;
+		for (const ValuePtr& vp : ll)
+		{
+			if (not first) out.push_back(',');
+			first = false;
+			encode_value(out, vp, embed, b64);
+		}
+	}
+	else if (nameserver().isA(typ, BOOL_VALUE))
+	{
+		put_quote(out, embed);
+		out += BoolValueCast(v)->hex_string();
+		put_quote(out, embed);
+	}
+	else if (nameserver().isA(typ, VOID_VALUE))
+	{
+		put_quote(out, embed);
+		put_quote(out, embed);
+	}
+	else
+	{
+		append_quoted(out, "Error: don't know how to print this", embed);
+	}
+
+	out += "]}";
+}
+
+void Json::encode_atom_values(std::string& out, const Handle& h,
+                              bool embed, bool b64)
+{
+	out.push_back('[');
+	if (nullptr == h) { out.push_back(']'); return; }
+
+	bool first = true;
+	for (const Handle& key: h->getKeys())
+	{
+		if (not first) out.push_back(',');
+		first = false;
+		out.push_back('{');
+		put_quote(out, embed);
+		out += "key";
+		put_quote(out, embed);
+		out.push_back(':');
+		encode_atom(out, key, embed);
+		put_key(out, "value", embed);
+		encode_value(out, h->getValue(key), embed, b64);
+		out.push_back('}');
+	}
+	out.push_back(']');
+}
+
+// Everything but the closing brace of the Atom.
+static void dump_head(std::string& out, const Handle& h)
+{
+	Json::encode_atom(out, h);
+	out.pop_back();
+	put_key(out, "values", false);
+}
+
+void Json::dump_atom(std::string& out, const Handle& h, bool b64)
+{
+	if (not h->haveValues())
+	{
+		encode_atom(out, h);
+		return;
+	}
+	dump_head(out, h);
+	encode_atom_values(out, h, false, b64);
+	out.push_back('}');
+}
+
+void Json::dump_vatom(std::string& out, const Handle& h, const Handle& key,
+                      bool b64)
+{
+	dump_head(out, h);
+	out += "[{\"key\":";
+	encode_atom(out, key);
+	put_key(out, "value", false);
+	encode_value(out, h->getValue(key), false, b64);
+	out += "}]}";
+}
+
+void Json::encode_type_list(std::string& out,
+                            const std::vector<Type>& tlist, bool embed)
+{
+	out.push_back('[');
+	bool first = true;
+	for (const Type& t: tlist)
+	{
+		if (not first) out.push_back(',');
+		first = false;
+		put_quote(out, embed);
+		out += nameserver().getTypeName(t);
+		put_quote(out, embed);
+	}
+	out.push_back(']');
+}
+
 /* ============================= END OF FILE ================= */
@@ -35,48 +35,188 @@
 #include <time.h>
 
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <functional>
-#include <iomanip>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
 using namespace opencog;
 
-// Helper function to parse boolean parameters from commands
-static bool parse_bool_param(const std::string& cmd, size_t& pos, size_t epos, bool js_mode)
+// -----------------------------------------------
+/// The parsed command envelope. In js-mode, the commands are all of
+/// the form
+///    AtomSpace.someCommand(args)
+/// In MCP-mode, the commands are all of the form
+///    { "tool": "someToolName", "params": { args }}
+/// The envelope is parsed exactly once, before dispatch. The handlers
+/// get the offsets of the arguments, and never look at the envelope.
+/// If the (first) argument is a JSON object, it is scanned onto the
+/// tape, and the handlers look up fields there, instead of searching
+/// for them in the string.
+struct JSRequest
 {
-	bool recursive = false;
-	if (js_mode) {
+	bool js_mode;     // reply with JSON, instead of s-expressions
+	bool positional;  // more arguments may follow the first, JS-style
+	size_t tool;      // start of the tool name
+	size_t tool_len;  // length of the tool name
+	size_t pos;       // start of the arguments
+	size_t epos;      // one past the end of the arguments
+	bool obj;         // true if the first argument is an object
+	JsonTape tape;    // the first argument, if it is an object
+};
+
+// Tape index of the object argument, if any.
+#define ARG_OBJ (rq.obj ? 0 : JsonTape::npos)
+
+/// Fill in the request from a `{"tool": ..., "params": {...}}` object
+/// at index `call` on the tape. The params are rescanned onto their
+/// own tape, because the handlers expect the argument object to be at
+/// the root. Returns false if the object is malformed.
+static bool parse_call(const std::string& cmd, const JsonTape& tape,
+                       size_t call, JSRequest& rq)
+{
+	size_t tpos = tape.field(cmd, call, "tool");
+	size_t ppos = tape.field(cmd, call, "params");
+	if (JsonTape::npos == tpos or JsonToken::STRING != tape[tpos].kind or
+	    JsonTape::npos == ppos or JsonToken::OBJECT != tape[ppos].kind)
+		return false;
+
+	rq.positional = false;
+	rq.tool = tape[tpos].start + 1;
+	rq.tool_len = tape[tpos].end - tape[tpos].start - 2;
+	rq.pos = tape[ppos].start;
+	rq.epos = tape[ppos].end;
+	rq.obj = true;
+	return rq.tape.scan(cmd, rq.pos);
+}
+
+/// Returns false if the envelope is malformed.
+static bool parse_envelope(const std::string& cmd, size_t cpos,
+                           JSRequest& rq)
+{
+	// If we find an open brace at the start of the string,
+	// then we are in MCP-mode. Else we are in JS-mode.
+	rq.js_mode = ('{' != cmd[cpos]);
+	rq.positional = rq.js_mode;
+	if (rq.js_mode and 'A' != cmd[cpos]) return false;
+
+	if (rq.js_mode)
+	{
+		cpos = cmd.find_first_of(".", cpos);
+		if (std::string::npos == cpos) return false;
+
+		cpos = cmd.find_first_not_of(". \n\t", cpos);
+		if (std::string::npos == cpos) return false;
+
+		size_t epos = cmd.find_first_of("( \n\t", cpos);
+		if (std::string::npos == epos) return false;
+
+		rq.tool = cpos;
+		rq.tool_len = epos - cpos;
+		rq.pos = epos + 1;
+		rq.epos = cmd.size();
+
+		size_t apos = cmd.find_first_not_of(" \n\t", rq.pos);
+		rq.obj = (std::string::npos != apos and '{' == cmd[apos]);
+		if (rq.obj and not rq.tape.scan(cmd, apos)) return false;
+		return true;
+	}
+
+	// In MCP-mode, the whole envelope is scanned, and the tool and
+	// params are looked up as fields, in any order.
+	JsonTape env;
+	if (not env.scan(cmd, cpos)) return false;
+	return parse_call(cmd, env, 0, rq);
+}
+
+// Helper function to parse boolean parameters from commands.
+// In JS-mode, the boolean is positional, and follows the first
+// argument. Otherwise, look for a "subclass" or "recursive" field
+// in the object argument.
+static bool parse_bool_param(const std::string& cmd, size_t& pos,
+                             const JSRequest& rq)
+{
+	if (rq.positional) {
 		pos = cmd.find_first_not_of(",) \n\t", pos);
 		if (std::string::npos != pos) {
-			recursive = true;
 			if (0 == cmd.compare(pos, 1, "0") or
 			    0 == cmd.compare(pos, 5, "false") or
 			    0 == cmd.compare(pos, 5, "False"))
-				recursive = false;
-		}
-	} else {
-		// In MCP mode, look for "subclass" or "recursive" field
-		// Search backwards from epos to find the boolean
-		size_t bool_pos = cmd.rfind("\"subclass\"", epos);
-		if (std::string::npos == bool_pos)
-			bool_pos = cmd.rfind("\"recursive\"", epos);
-		if (std::string::npos != bool_pos) {
-			bool_pos = cmd.find(':', bool_pos);
-			if (std::string::npos != bool_pos && bool_pos < epos) {
-				bool_pos = cmd.find_first_not_of(": \n\t", bool_pos);
-				if (std::string::npos != bool_pos && bool_pos < epos) {
-					if (0 == cmd.compare(bool_pos, 4, "true"))
-						recursive = true;
-				}
-			}
+				return false;
+			return true;
 		}
 	}
-	return recursive;
+
+	if (not rq.obj) return false;
+
+	size_t bool_pos = rq.tape.field(cmd, 0, "subclass");
+	if (JsonTape::npos == bool_pos)
+		bool_pos = rq.tape.field(cmd, 0, "recursive");
+	if (JsonTape::npos == bool_pos) return false;
+	return rq.tape.is_true(cmd, bool_pos);
+}
+
+// MCP tool responses use the "content" format.
+// All responses (success or error) return text content.
+// The result text goes between the head and the tail.
+#define REPLY_HEAD "{\"content\": [{\"type\":\"text\", \"text\": \""
+#define REPLY_TAIL "\"}]}\n"
+
+// Simple values can be returned as quoted strings.
+#define RETURN(RV) { \
+	return REPLY_HEAD RV REPLY_TAIL; }
+
+// For s-expression results, we need to escape quotes and wrap the
+// text as a string within the content array. Newlines are flattened
+// to blanks. This is done in one pass, as the text is copied.
+static void append_text(std::string& rs, std::string_view srv)
+{
+	rs.reserve(rs.size() + srv.size() + srv.size()/16 + sizeof(REPLY_TAIL));
+	for (char c : srv)
+	{
+		if ('\n' == c) { rs.push_back(' '); continue; }
+		if ('"' == c or '\\' == c) rs.push_back('\\');
+		rs.push_back(c);
+	}
+}
+
+static std::string retstr(const std::string& srv)
+{
+	std::string rs(REPLY_HEAD);
+	append_text(rs, srv);
+	rs += REPLY_TAIL;
+	return rs;
 }
 
-static std::string reterr(const std::string& cmd)
+#define RETURNSTR(RV) { return retstr(RV); }
+
+// Request text is quoted into error replies; it must be escaped,
+// else the reply is not valid JSON.
+static std::string quote(std::string_view txt)
 {
-	return "{\"content\": [{\"type\":\"text\", \"text\": \"Error: Invalid Request - " + cmd + "\"}], \"isError\": true}\n";
+	std::string rs;
+	append_text(rs, txt);
+	return rs;
+}
+
+// The arguments, from `pos` to the end of the request. Inside of a
+// batch, this is just the one call, and not the whole batch.
+static std::string_view argtext(const std::string& cmd, size_t pos,
+                                const JSRequest& rq)
+{
+	if (rq.epos <= pos or cmd.size() < rq.epos) return std::string_view();
+	return std::string_view(cmd).substr(pos, rq.epos - pos);
+}
+
+static std::string reterr(std::string_view req)
+{
+	return "{\"content\": [{\"type\":\"text\", \"text\": \"Error: Invalid Request - " + quote(req) + "\"}], \"isError\": true}\n";
 }
 
 static std::string retmsgerr(const std::string& errmsg)
@@ -84,548 +224,960 @@ static std::string retmsgerr(const std::string& errmsg)
 	return "{\"content\": [{\"type\":\"text\", \"text\": \"Error: Invalid params - " + errmsg + "\"}], \"isError\": true}\n";
 }
 
-// MCP tool responses use the "content" format.
-// All responses (success or error) return text content.
-// Simple values can be returned as quoted strings.
-#define RETURN(RV) { \
-	return "{\"content\": [{\"type\":\"text\", \"text\": \"" RV "\"}]}\n"; }
-
-// For complex results (JSON structures), we need to escape quotes
-// and wrap the JSON as a text string within the content array.
-#define RETURNSTR(RV) { \
-	std::string srv(RV); \
-	std::replace(srv.begin(), srv.end(), '\n', ' '); \
-	std::stringstream ss; \
-	ss << std::quoted(srv); \
-	std::string rs = "{\"content\": [{\"type\":\"text\", \"text\": "; \
-	rs += ss.str(); \
-	rs += "}]}\n"; \
-	return rs; \
-	}
+#define RETERR return reterr(argtext(cmd, rq.pos, rq))
+
+// JSON results are printed by the compact encoders directly into
+// the reply, already escaped; they are never quoted a second time.
+#define BEGIN_REPLY \
+	std::string rs(REPLY_HEAD);
+
+#define END_REPLY { \
+	rs += REPLY_TAIL; \
+	return rs; }
 
 // Common boilerplate
 #define CHK_FOR_JSON_ARG \
-	size_t brace = cmd.find_first_not_of(" \n\t", pos); \
-	bool is_json_object = (brace != std::string::npos and cmd[brace] == '{');
+	bool is_json_object = rq.obj;
 
 #define GET_TYPE \
 	Type t = NOTYPE; \
 	try { \
-		t = Json::decode_type_arg(cmd, pos); \
+		if (rq.obj) { \
+			t = Json::decode_type(cmd, rq.tape, rq.tape.field(cmd, 0, "type")); \
+			pos = rq.tape[0].end; \
+		} \
+		else t = Json::decode_type(cmd, pos); \
 	} catch(...) { \
-		return retmsgerr("Unknown type: " + cmd.substr(pos)); \
+		return retmsgerr("Unknown type: " + quote(argtext(cmd, pos, rq))); \
 	}
 
 #define GET_BOOL \
-	bool recursive = parse_bool_param(cmd, pos, epos, js_mode);
+	bool recursive = parse_bool_param(cmd, pos, rq);
 
 #define GET_ATOM(rv) \
-	Handle h = Json::decode_atom(cmd, pos, epos); \
-	if (nullptr == h) return reterr(cmd); \
+	Handle h = Json::decode_atom(cmd, rq.tape, ARG_OBJ); \
+	if (nullptr == h) RETERR; \
+	epos = rq.tape[0].end; \
 	h = as->get_atom(h); \
 	if (nullptr == h) RETURN(rv);
 
 #define ADD_ATOM \
-	Handle h = Json::decode_atom(cmd, pos, epos); \
-	if (nullptr == h) return reterr(cmd); \
+	Handle h = Json::decode_atom(cmd, rq.tape, ARG_OBJ); \
+	if (nullptr == h) RETERR; \
 	h = as->add_atom(h); \
 	if (nullptr == h) return retmsgerr("No such Atom");
 
 #define GET_KEY \
-	pos = cmd.find("\"key\":", epos); \
-	if (std::string::npos == pos) return reterr(cmd); \
-	pos += 6; \
-	epos = cmd.size(); \
-	Handle k = Json::decode_atom(cmd, pos, epos); \
-	if (nullptr == k) return reterr(cmd); \
-	k = as->add_atom(k); \
-	pos = cmd.find(',', epos); \
-	if (std::string::npos == pos) return retmsgerr("No such Key");
+	Handle k = Json::decode_atom(cmd, rq.tape, \
+		rq.tape.field(cmd, 0, "key")); \
+	if (nullptr == k) RETERR; \
+	k = as->add_atom(k);
 
 #define GET_VALUE \
-	pos = cmd.find("\"value\":", pos); \
-	if (std::string::npos != pos) \
-		pos += 8; \
-	else { \
-		pos = cmd.find("\"values\":", pos); \
-		if (std::string::npos == pos) return reterr(cmd); \
-		pos += 9; \
-	} \
-	epos = cmd.size(); \
-	ValuePtr v = Json::decode_value(cmd, pos, epos); \
-	if (nullptr == v) return reterr(cmd);
+	size_t vpos = rq.tape.field(cmd, 0, "value"); \
+	if (JsonTape::npos == vpos) \
+		vpos = rq.tape.field(cmd, 0, "values"); \
+	ValuePtr v = Json::decode_value(cmd, rq.tape, vpos); \
+	if (nullptr == v) RETERR;
+
+// Send FloatValues and BoolValues as base64, if asked for.
+#define GET_B64 \
+	bool b64 = false; \
+	if (rq.obj) { \
+		size_t bpos = rq.tape.field(cmd, 0, "b64"); \
+		b64 = (JsonTape::npos != bpos and rq.tape.is_true(cmd, bpos)); \
+	}
 
-/// The cogserver provides a network API to send/receive Atoms, encoded
-/// as JSON, over the internet. This is NOT as efficient as the
-/// s-expression API, but is more convenient for web developers.
-//
-std::string JSCommands::interpret_command(AtomSpace* as,
-                                          const std::string& cmd)
-{
-	// Fast dispatch. There should be zero hash collisions
-	// here. If there are, we are in trouble. (Well, if there
-	// are collisions, just prepend a dot?)
-	static const size_t versn = std::hash<std::string>{}("version");
-	static const size_t gtatm = std::hash<std::string>{}("getAtoms");
-	static const size_t gtsub = std::hash<std::string>{}("getSubTypes");
-	static const size_t gtsup = std::hash<std::string>{}("getSuperTypes");
-	static const size_t haven = std::hash<std::string>{}("haveNode");
-	static const size_t havel = std::hash<std::string>{}("haveLink");
-	static const size_t havea = std::hash<std::string>{}("haveAtom");
-	static const size_t makea = std::hash<std::string>{}("makeAtom");
-	static const size_t gtinc = std::hash<std::string>{}("getIncoming");
-	static const size_t gtkey = std::hash<std::string>{}("getKeys");
-	static const size_t gtval = std::hash<std::string>{}("getValues");
-	static const size_t gtvak = std::hash<std::string>{}("getValueAtKey");
-	static const size_t stval = std::hash<std::string>{}("setValue");
-	static const size_t execu = std::hash<std::string>{}("execute");
-	static const size_t extra = std::hash<std::string>{}("extract");
-	static const size_t rpcnt = std::hash<std::string>{}("reportCounts");
+// Handler boilerplate. The macros above expect these names.
+#define HANDLER(NAME) \
+	static std::string NAME(AtomSpace* as, const std::string& cmd, \
+	                        const JSRequest& rq)
 
-	// Ignore comments, blank lines
-	size_t cpos = cmd.find_first_not_of(" \n\t");
-	if (std::string::npos == cpos) return "";
-	if ('/' == cmd[cpos]) return "";
-	if ('#' == cmd[cpos]) return "";
+typedef std::string (*JSHandler)(AtomSpace*, const std::string&,
+                                 const JSRequest&);
 
-	// In js-mode, the commands are all of the form
-	//    AtomSpace.someCommand(args)
-	// In MCP-mode, the commands are all of the form
-	//    { "tool": "someToolName", "params": { args }}
-	// So if we find an open brace at the start of the string,
-	// then we are in MCP-mode. Else we are in JS-mode.
+static JSHandler find_handler(std::string_view);
 
-	bool js_mode = true;
+#define ARGS \
+	size_t pos = rq.pos; \
+	[[maybe_unused]] size_t epos = rq.epos; \
+	[[maybe_unused]] bool js_mode = rq.js_mode;
 
-	if ('{' == cmd[cpos])
-		js_mode = false;
-	else if ('A' != cmd[cpos])
-		return reterr(cmd);
+// -----------------------------------------------
+// Get version
+// AtomSpace.version()
+// AtomSpace.version({})
+HANDLER(do_version)
+{
+	RETURN(ATOMSPACE_VERSION_STRING);
+}
 
-	size_t pos, epos;
-	size_t act;
+// -----------------------------------------------
+// Get subtypes of the named type.
+// AtomSpace.getSubTypes("Link")
+// AtomSpace.getSubTypes("Link", true)
+// AtomSpace.getSubTypes({ "type": "Link"})
+// AtomSpace.getSubTypes({ "type": "Link", "recursive": true})
+HANDLER(do_get_sub_types)
+{
+	ARGS;
+	GET_TYPE;
+	GET_BOOL;
 
-	if (js_mode)
-	{
-		cpos = cmd.find_first_of(".", cpos);
-		if (std::string::npos == cpos) return reterr(cmd);
+	std::vector<Type> vect;
+	if (recursive)
+		nameserver().getChildrenRecursive(t, std::back_inserter(vect));
+	else
+		nameserver().getChildren(t, std::back_inserter(vect));
 
-		cpos = cmd.find_first_not_of(". \n\t", cpos);
-		if (std::string::npos == cpos) return reterr(cmd);
+	BEGIN_REPLY;
+	Json::encode_type_list(rs, vect, true);
+	END_REPLY;
+}
 
-		epos = cmd.find_first_of("( \n\t", cpos);
-		if (std::string::npos == epos) return reterr(cmd);
-		pos = epos + 1;
+// -----------------------------------------------
+// Get supertypes of the named type.
+// AtomSpace.getSuperTypes("ListLink")
+// AtomSpace.getSuperTypes("ListLink", true)
+// AtomSpace.getSuperTypes({ "type": "ListLink", "recursive": true})
+// AtomSpace.getSuperTypes({ "type": "ListLink"})
+HANDLER(do_get_super_types)
+{
+	ARGS;
+	GET_TYPE;
+	GET_BOOL;
 
-		act = std::hash<std::string>{}(cmd.substr(cpos, epos-cpos));
-		epos = cmd.size();
-	}
+	std::vector<Type> vect;
+	if (recursive)
+		nameserver().getParentsRecursive(t, std::back_inserter(vect));
 	else
-	{
-		cpos = cmd.find("\"tool\":", cpos);
-		if (std::string::npos == cpos) return reterr(cmd);
-		cpos += 7; // 7 == strlen("\"tool\":");
-
-		cpos = cmd.find_first_not_of("\" \n\t", cpos);
-		if (std::string::npos == cpos) return reterr(cmd);
-
-		size_t tool_end = cmd.find_first_of("\", \n\t", cpos);
-		if (std::string::npos == tool_end) return reterr(cmd);
-
-		// Extract the tool name
-		std::string tool_name = cmd.substr(cpos, tool_end-cpos);
-		act = std::hash<std::string>{}(tool_name);
-
-		// OK, so now pos and tool_end bracket the tool name.
-		// Advance cpos past the params.
-		pos = cmd.find("\"params\":", tool_end);
-		if (std::string::npos == pos) return reterr(cmd);
-		pos += 9; // 9 == strlen("\"params\":");
-
-		// For MCP mode, find the closing } of the params object
-		// We need to find the matching } for the { that comes after "params":
-		int brace_count = 0;
-		size_t scan_pos = pos;
-		epos = std::string::npos;
-
-		while (scan_pos < cmd.size()) {
-			if (cmd[scan_pos] == '{') {
-				brace_count++;
-			} else if (cmd[scan_pos] == '}') {
-				brace_count--;
-				if (brace_count == 0) {
-					epos = scan_pos + 1; // Include the closing }
-					break;
-				}
-			}
-			scan_pos++;
-		}
+		nameserver().getParents(t, std::back_inserter(vect));
 
-		if (std::string::npos == epos) return reterr(cmd);
-	}
+	BEGIN_REPLY;
+	Json::encode_type_list(rs, vect, true);
+	END_REPLY;
+}
+
+// -----------------------------------------------
+// Paging.
+//
+// A large AtomSpace can hold millions of Atoms of one type; sending
+// them all in one reply makes for a reply of hundreds of megabytes,
+// which the client then times out on. If a "limit" is given, then at
+// most that many Atoms are sent, and, if there are more, the reply
+// carries an MCP-style "nextCursor":
+//    {"content": [...], "nextCursor": "5f3e0a1b2c3d4e5f"}
+// Passing {"cursor": "5f3e0a1b2c3d4e5f"} gets the next page. The
+// cursor holds on to a window of the Atoms after the first page, so
+// that the later pages are not found all over again. The window is at
+// most CURSOR_WINDOW Atoms; when it runs out, the search is run again,
+// and the window moves along. Thus, paging through a huge result set
+// costs a few searches, instead of holding on to all of it. An
+// "offset" skips that many Atoms at the start of the first page.
+//
+// The AtomSpace does not find Atoms in any particular order, and so
+// paged results are sorted by Atom hash. The window picks up just
+// after the last Atom sent; Atoms added or extracted in between pages
+// do not cause others to be skipped, or to be sent twice.
+//
+// A "fields" list picks what is printed for each Atom, out of "type",
+// "name", "outgoing" and "values". The default is the first three;
+// adding "values" gets all of the Values on each Atom, too. This only
+// applies to JSON replies; s-expression replies are never projected.
+
+#define FIELD_TYPE      0x1
+#define FIELD_NAME      0x2
+#define FIELD_OUTGOING  0x4
+#define FIELD_VALUES    0x8
+#define FIELD_B64       0x10   // values in base64
+#define FIELD_ATOM      (FIELD_TYPE | FIELD_NAME | FIELD_OUTGOING)
+
+// Cursors not used for this many seconds are dropped.
+#define CURSOR_IDLE_SECS 300
+
+// At most this many cursors are kept. If there are more, the least
+// recently used one is dropped.
+#define MAX_CURSORS 64
+
+// At most this many Atoms are held by any one cursor.
+#define CURSOR_WINDOW 65536
 
-	// -----------------------------------------------
-	// Get version
-	// AtomSpace.version()
-	// AtomSpace.version({})
-	if (versn == act)
+struct Paging
+{
+	size_t offset = 0;
+	size_t limit = 0;       // zero means no limit
+	unsigned fields = FIELD_ATOM;
+	bool have_fields = false;
+	std::string cursor;
+};
+
+typedef std::function<HandleSeq (AtomSpace*)> Search;
+
+struct Cursor
+{
+	std::weak_ptr<AtomSpace> as;
+	Search search;          // finds all of the Atoms, again
+	HandleSeq atoms;        // window onto all of the Atoms
+	size_t next;            // index in the window of the next to send
+	bool more;              // true if there is more past the window
+	Handle last;            // the last Atom sent
+	size_t limit;
+	unsigned fields;
+	time_t last_used;
+};
+
+static std::mutex cursor_mtx;
+static std::unordered_map<std::string, Cursor> cursors;
+
+static bool get_count(const std::string& cmd, const JsonTape& tape,
+                      size_t i, size_t& n)
+{
+	double d;
+	try { d = tape.get_double(cmd, i); }
+	catch (...) { return false; }
+	if (not std::isfinite(d) or d < 0.0 or std::floor(d) != d) return false;
+	n = (size_t) d;
+	return true;
+}
+
+/// Get the paging fields out of the argument object. Returns an error
+/// message, or the empty string if all is well.
+static std::string parse_paging(const std::string& cmd,
+                                const JSRequest& rq, Paging& pg)
+{
+	if (not rq.obj) return "";
+	const JsonTape& tape = rq.tape;
+
+	size_t i = tape.field(cmd, 0, "offset");
+	if (JsonTape::npos != i and not get_count(cmd, tape, i, pg.offset))
+		return "Bad offset";
+
+	i = tape.field(cmd, 0, "limit");
+	if (JsonTape::npos != i and
+	    (not get_count(cmd, tape, i, pg.limit) or 0 == pg.limit))
+		return "Bad limit";
+
+	i = tape.field(cmd, 0, "cursor");
+	if (JsonTape::npos != i)
 	{
-		RETURN(ATOMSPACE_VERSION_STRING);
+		if (JsonToken::STRING != tape[i].kind) return "Bad cursor";
+		pg.cursor = tape.get_raw(cmd, i);
 	}
 
-	// -----------------------------------------------
-	// Get subtypes of the named type.
-	// AtomSpace.getSubTypes("Link")
-	// AtomSpace.getSubTypes("Link", true)
-	// AtomSpace.getSubTypes({ "type": "Link"})
-	// AtomSpace.getSubTypes({ "type": "Link", "recursive": true})
-	if (gtsub == act)
-	{
-		GET_TYPE;
-		GET_BOOL;
+	i = tape.field(cmd, 0, "fields");
+	if (JsonTape::npos == i) return "";
+	if (JsonToken::ARRAY != tape[i].kind) return "Bad fields";
 
-		std::vector<Type> vect;
-		if (recursive)
-			nameserver().getChildrenRecursive(t, std::back_inserter(vect));
-		else
-			nameserver().getChildren(t, std::back_inserter(vect));
-		RETURNSTR(Json::encode_type_list(vect));
+	pg.fields = 0;
+	pg.have_fields = true;
+	for (size_t f = tape.begin(i); f < tape.end(i); f = tape[f].next)
+	{
+		if (JsonToken::STRING != tape[f].kind) return "Bad fields";
+		std::string name = tape.get_raw(cmd, f);
+		if ("type" == name) pg.fields |= FIELD_TYPE;
+		else if ("name" == name) pg.fields |= FIELD_NAME;
+		else if ("outgoing" == name) pg.fields |= FIELD_OUTGOING;
+		else if ("values" == name) pg.fields |= FIELD_VALUES;
+		else return "Unknown field: " + name;
 	}
+	if (0 == pg.fields) return "Bad fields";
 
-	// -----------------------------------------------
-	// Get supertypes of the named type.
-	// AtomSpace.getSuperTypes("ListLink")
-	// AtomSpace.getSuperTypes("ListLink", true)
-	// AtomSpace.getSuperTypes({ "type": "ListLink", "recursive": true})
-	// AtomSpace.getSuperTypes({ "type": "ListLink"})
-	if (gtsup == act)
-	{
-		GET_TYPE;
-		GET_BOOL;
+	i = tape.field(cmd, 0, "b64");
+	if (JsonTape::npos != i and tape.is_true(cmd, i))
+		pg.fields |= FIELD_B64;
+	return "";
+}
+
+// The cursor names are opaque; they are not counted up from zero,
+// so that clients don't get ideas about guessing them.
+static std::string new_cursor_name(void)
+{
+	static const uint64_t salt =
+		((uint64_t) std::random_device{}() << 32) | std::random_device{}();
+	static uint64_t count = 0;
+
+	count++;
+	char buf[20];
+	snprintf(buf, sizeof(buf), "%016llx",
+		(unsigned long long) (salt ^ (count * 0x9e3779b97f4a7c15ULL)));
+	return buf;
+}
+
+/// The order in which paged results are sent. Hash collisions are
+/// broken by address; this is stable, as the cursor holds on to the
+/// last Atom sent.
+static bool page_order(const Handle& a, const Handle& b)
+{
+	ContentHash ha = a->get_hash();
+	ContentHash hb = b->get_hash();
+	if (ha != hb) return ha < hb;
+	return a.get() < b.get();
+}
+
+/// Fill the window with the Atoms from `all`, which must be in page
+/// order, starting with the first one after the last one sent.
+static void fill_window(Cursor& cu, HandleSeq&& all)
+{
+	auto beg = all.begin();
+	if (cu.last)
+		beg = std::upper_bound(all.begin(), all.end(), cu.last, page_order);
+	auto end = beg + std::min((size_t) CURSOR_WINDOW,
+	                          (size_t) (all.end() - beg));
+	cu.atoms.assign(std::make_move_iterator(beg),
+	                std::make_move_iterator(end));
+	cu.next = 0;
+	cu.more = (all.end() != end);
+}
+
+/// Hang on to (some of) the rest of the Atoms, and return the cursor
+/// name.
+static std::string save_cursor(AtomSpace* as, const Search& search,
+                               HandleSeq&& atoms, size_t next,
+                               const Paging& pg)
+{
+	Cursor cu{AtomSpaceCast(as), search, {}, 0, false, atoms[next-1],
+	          pg.limit, pg.fields, time(nullptr)};
+	fill_window(cu, std::move(atoms));
+
+	time_t now = cu.last_used;
+	std::lock_guard<std::mutex> lck(cursor_mtx);
 
-		std::vector<Type> vect;
-		if (recursive)
-			nameserver().getParentsRecursive(t, std::back_inserter(vect));
+	for (auto it = cursors.begin(); it != cursors.end(); )
+	{
+		if (CURSOR_IDLE_SECS < now - it->second.last_used)
+			it = cursors.erase(it);
 		else
-			nameserver().getParents(t, std::back_inserter(vect));
-		RETURNSTR(Json::encode_type_list(vect));
+			it++;
 	}
 
-	// -----------------------------------------------
-	// AtomSpace.getAtoms("Node") // no subclassing
-	// AtomSpace.getAtoms("Node", true)
-	// AtomSpace.getAtoms({"type": "Node"}) // no sublassing
-	// AtomSpace.getAtoms({"type": "Node", "subclass": true})
-	if (gtatm == act)
+	if (MAX_CURSORS <= cursors.size())
+		cursors.erase(std::min_element(cursors.begin(), cursors.end(),
+			[](const auto& a, const auto& b) {
+				return a.second.last_used < b.second.last_used; }));
+
+	std::string name = new_cursor_name();
+	cursors.emplace(name, std::move(cu));
+	return name;
+}
+
+/// Print just the requested fields of the Atom.
+static void encode_fields(std::string& rs, const Handle& h, unsigned fields)
+{
+	if (FIELD_ATOM == fields)
 	{
-		GET_TYPE;
-		GET_BOOL;
+		Json::encode_atom(rs, h, true);
+		return;
+	}
 
-		HandleSeq hset;
-		as->get_handles_by_type(hset, t, recursive);
-		std::string rv;
-		if (js_mode)
-		{
-			// JSON format: array of atoms
-			rv = "[\n";
-			bool first = true;
-			for (const Handle& h: hset)
-			{
-				if (not first) { rv += ",\n"; } else { first = false; }
-				rv += Json::encode_atom(h, "  ");
-			}
-			rv += "]";
-		}
-		else
+	rs.push_back('{');
+	bool first = true;
+	auto put_key = [&](const char* key) {
+		if (not first) { rs.push_back(','); } else { first = false; }
+		rs += "\\\"";
+		rs += key;
+		rs += "\\\":";
+	};
+
+	if (fields & FIELD_TYPE)
+	{
+		put_key("type");
+		rs += "\\\"";
+		rs += nameserver().getTypeName(h->get_type());
+		rs += "\\\"";
+	}
+	if ((fields & FIELD_NAME) and h->is_node())
+	{
+		put_key("name");
+		Json::append_quoted(rs, h->get_name(), true);
+	}
+	if ((fields & FIELD_OUTGOING) and h->is_link())
+	{
+		put_key("outgoing");
+		rs.push_back('[');
+		bool ofirst = true;
+		for (const Handle& ho : h->getOutgoingSet())
 		{
-			rv = "(list ";
-			for (const Handle& h: hset)
-				rv += Sexpr::encode_atom(h);
-			rv += ")";
+			if (not ofirst) { rs.push_back(','); } else { ofirst = false; }
+			Json::encode_atom(rs, ho, true);
 		}
-		RETURNSTR(rv);
+		rs.push_back(']');
 	}
+	if (fields & FIELD_VALUES)
+	{
+		put_key("values");
+		Json::encode_atom_values(rs, h, true, 0 != (fields & FIELD_B64));
+	}
+	rs.push_back('}');
+}
 
-	// -----------------------------------------------
-	// AtomSpace.haveNode("Concept", "foo")
-	// AtomSpace.haveNode({ "type": "Concept", "name": "foo"})
-	if (haven == act)
+/// Start a reply holding the Atoms in `hs` from `beg` up to `end`.
+/// The `stale` flag says that the Atoms were found during some
+/// earlier request, and may have been extracted since then.
+static std::string encode_page(const HandleSeq& hs, size_t beg, size_t end,
+                               unsigned fields, bool js_mode, bool stale)
+{
+	std::string rs(REPLY_HEAD);
+	if (js_mode)
 	{
-		CHK_FOR_JSON_ARG;
-		if (is_json_object)
+		rs.push_back('[');
+		bool first = true;
+		for (size_t i = beg; i < end; i++)
 		{
-			GET_ATOM("false")
-			RETURN("true");
+			if (stale and nullptr == hs[i]->getAtomSpace()) continue;
+			if (not first) { rs.push_back(','); } else { first = false; }
+			encode_fields(rs, hs[i], fields);
 		}
+		rs.push_back(']');
+		return rs;
+	}
 
-		// Function argument format: type followed by name
-		GET_TYPE;
+	std::string rv = "(list ";
+	for (size_t i = beg; i < end; i++)
+	{
+		if (stale and nullptr == hs[i]->getAtomSpace()) continue;
+		rv += Sexpr::encode_atom(hs[i]);
+	}
+	rv += ")";
+	append_text(rs, rv);
+	return rs;
+}
 
-		if (not nameserver().isA(t, NODE))
-			return retmsgerr("Type is not a Node type: " + cmd.substr(epos));
+static std::string end_page(std::string& rs, const std::string& next)
+{
+	if (next.empty())
+	{
+		rs += REPLY_TAIL;
+		return rs;
+	}
+	rs += "\"}], \"nextCursor\": \"";
+	rs += next;
+	rs += "\"}\n";
+	return rs;
+}
 
-		pos = cmd.find_first_not_of(",) \n\t", pos);
-		std::string name = Json::get_node_name(cmd, pos, epos);
-		Handle h = as->get_node(t, std::move(name));
+/// Reply with the first page of `hset`, which was found with `search`.
+/// If there is more, then the rest goes to a new cursor.
+static std::string first_page(AtomSpace* as, const Search& search,
+                              HandleSeq&& hset, const Paging& pg,
+                              bool js_mode)
+{
+	if (0 < pg.limit or 0 < pg.offset)
+		std::sort(hset.begin(), hset.end(), page_order);
 
-		if (nullptr == h) RETURN("false");
-		RETURN("true");
+	size_t beg = std::min(pg.offset, hset.size());
+	size_t end = hset.size();
+	if (0 < pg.limit and pg.limit < end - beg)
+		end = beg + pg.limit;
+
+	std::string rs(encode_page(hset, beg, end, pg.fields, js_mode, false));
+
+	std::string next;
+	if (end < hset.size())
+		next = save_cursor(as, search, std::move(hset), end, pg);
+	return end_page(rs, next);
+}
+
+/// Reply with the next page of the named cursor. A new "limit" or
+/// "fields", if given, apply to this and all later pages.
+static std::string next_page(AtomSpace* as, const Paging& pg,
+                             bool js_mode)
+{
+	// If the window does not hold all of the next page, then the
+	// search has to be run again. This is done without the lock,
+	// as it might take a while.
+	Search search;
+	{
+		std::lock_guard<std::mutex> lck(cursor_mtx);
+		auto it = cursors.find(pg.cursor);
+		if (cursors.end() == it or as != it->second.as.lock().get())
+			return retmsgerr("No such cursor: " + quote(pg.cursor));
+
+		Cursor& cu = it->second;
+		if (0 < pg.limit) cu.limit = pg.limit;
+		if (pg.have_fields) cu.fields = pg.fields;
+
+		if (cu.more and cu.atoms.size() < cu.next + cu.limit)
+			search = cu.search;
 	}
 
-	// -----------------------------------------------
-	// AtomSpace.haveLink("List", [{ "type": "ConceptNode", "name": "foo"}])
-	// AtomSpace.haveLink({ "type": "List", "outgoing": [{ "type": "ConceptNode", "name": "foo"}]})
-	if (havel == act)
+	HandleSeq all;
+	if (search)
 	{
-		CHK_FOR_JSON_ARG;
-		if (is_json_object)
-		{
-			GET_ATOM("false")
-			RETURN("true");
-		}
+		all = search(as);
+		std::sort(all.begin(), all.end(), page_order);
+	}
 
-		// Function argument format: type followed by outgoing array
-		GET_TYPE;
+	HandleSeq page;
+	unsigned fields;
+	std::string next;
+	{
+		std::lock_guard<std::mutex> lck(cursor_mtx);
+		auto it = cursors.find(pg.cursor);
+		if (cursors.end() == it)
+			return retmsgerr("No such cursor: " + quote(pg.cursor));
+
+		Cursor& cu = it->second;
+		if (search) fill_window(cu, std::move(all));
+		fields = cu.fields;
+
+		size_t end = std::min(cu.next + cu.limit, cu.atoms.size());
+		page.assign(cu.atoms.begin() + cu.next, cu.atoms.begin() + end);
+		if (cu.next < end) cu.last = cu.atoms[end-1];
+		cu.next = end;
+		cu.last_used = time(nullptr);
+
+		if (end < cu.atoms.size() or cu.more)
+			next = pg.cursor;
+		else
+			cursors.erase(it);
+	}
 
-		if (not nameserver().isA(t, LINK))
-			return retmsgerr("Type is not a Link type: " + cmd.substr(epos));
+	std::string rs(encode_page(page, 0, page.size(), fields, js_mode, true));
+	return end_page(rs, next);
+}
 
-		pos = cmd.find_first_not_of(", \n\t", pos);
-		// Skip the opening '[' if present
-		if (pos < cmd.size() && cmd[pos] == '[') pos++;
+#define GET_PAGING \
+	Paging pg; \
+	{ \
+		std::string perr = parse_paging(cmd, rq, pg); \
+		if (not perr.empty()) return retmsgerr(perr); \
+	} \
+	if (not pg.cursor.empty()) return next_page(as, pg, js_mode);
+
+// -----------------------------------------------
+// AtomSpace.getAtoms("Node") // no subclassing
+// AtomSpace.getAtoms("Node", true)
+// AtomSpace.getAtoms({"type": "Node"}) // no sublassing
+// AtomSpace.getAtoms({"type": "Node", "subclass": true})
+// AtomSpace.getAtoms({"type": "Node", "limit": 1000})
+// AtomSpace.getAtoms({"cursor": "5f3e0a1b2c3d4e5f"})
+// AtomSpace.getAtoms({"type": "Concept", "fields": ["name", "values"]})
+HANDLER(do_get_atoms)
+{
+	ARGS;
+	GET_PAGING;
+	GET_TYPE;
+	GET_BOOL;
 
+	Search search = [t, recursive](AtomSpace* asp) {
 		HandleSeq hs;
+		asp->get_handles_by_type(hs, t, recursive);
+		return hs;
+	};
+	return first_page(as, search, search(as), pg, js_mode);
+}
 
-		size_t l = pos;
-		size_t r = epos;
-		while (std::string::npos != r)
-		{
-			l = cmd.find_first_not_of(" \n\t", l);
-			if (l == std::string::npos || cmd[l] == ']') break;
-
-			Handle ho = Json::decode_atom(cmd, l, r);
-			if (nullptr == ho) RETURN("false");
-			hs.push_back(ho);
-
-			// Look for the comma
-			l = cmd.find(",", r);
-			if (std::string::npos == l) break;
-			l ++;
-			r = epos;
-		}
-		Handle h = as->get_link(t, std::move(hs));
-
-		if (nullptr == h) RETURN("false");
+// -----------------------------------------------
+// AtomSpace.haveNode("Concept", "foo")
+// AtomSpace.haveNode({ "type": "Concept", "name": "foo"})
+HANDLER(do_have_node)
+{
+	ARGS;
+	CHK_FOR_JSON_ARG;
+	if (is_json_object)
+	{
+		GET_ATOM("false")
 		RETURN("true");
 	}
 
-	// -----------------------------------------------
-	// AtomSpace.haveAtom({ "type": "ConceptNode", "name": "foo"})
-	if (havea == act)
+	// Function argument format: type followed by name
+	GET_TYPE;
+
+	if (not nameserver().isA(t, NODE))
+		return retmsgerr("Type is not a Node type: " + quote(argtext(cmd, rq.pos, rq)));
+
+	pos = cmd.find_first_not_of(",) \n\t", pos);
+	std::string name = Json::get_node_name(cmd, pos, epos);
+	Handle h = as->get_node(t, std::move(name));
+
+	if (nullptr == h) RETURN("false");
+	RETURN("true");
+}
+
+// -----------------------------------------------
+// AtomSpace.haveLink("List", [{ "type": "ConceptNode", "name": "foo"}])
+// AtomSpace.haveLink({ "type": "List", "outgoing": [{ "type": "ConceptNode", "name": "foo"}]})
+HANDLER(do_have_link)
+{
+	ARGS;
+	CHK_FOR_JSON_ARG;
+	if (is_json_object)
 	{
-		GET_ATOM("false");
+		GET_ATOM("false")
 		RETURN("true");
 	}
 
-	// -----------------------------------------------
-	// AtomSpace.makeAtom({ "type": "ConceptNode", "name": "foo"})
-	// AtomSpace.makeAtom(
-	//    {"outgoing":
-	//       [{"type":"Concept","name":"start"},
-	//       {"type":"Concept","name":"finish"}],
-	//    "type":"EdgeLink"})
-	if (makea == act)
+	// Function argument format: type followed by outgoing array
+	GET_TYPE;
+
+	if (not nameserver().isA(t, LINK))
+		return retmsgerr("Type is not a Link type: " + quote(argtext(cmd, rq.pos, rq)));
+
+	// The outgoing set is scanned just once.
+	pos = cmd.find_first_not_of(", \n\t", pos);
+	JsonTape otape;
+	if (std::string::npos == pos or not otape.scan(cmd, pos) or
+	    JsonToken::ARRAY != otape[0].kind)
+		RETERR;
+
+	HandleSeq hs;
+	for (size_t i = otape.begin(0); i < otape.end(0); i = otape[i].next)
 	{
-		ADD_ATOM;
-		RETURN("true");
+		Handle ho = Json::decode_atom(cmd, otape, i);
+		if (nullptr == ho) RETURN("false");
+		hs.push_back(ho);
 	}
+	Handle h = as->get_link(t, std::move(hs));
 
-	// -----------------------------------------------
-	// AtomSpace.getIncoming({"type": "Concept", "name": "foo"})
-	// AtomSpace.getIncoming({"type": "Concept", "name": "foo"}, "Evaluation")
-	if (gtinc == act)
-	{
-		GET_ATOM("[]");
+	if (nullptr == h) RETURN("false");
+	RETURN("true");
+}
 
-		Type t = NOTYPE;
-		pos = cmd.find(",", epos);
-		if (std::string::npos != pos)
-		{
-			pos++;
-			try {
-				t = Json::decode_type(cmd, pos);
-			}
-			catch(...) {
-				return retmsgerr("Unknown type: " + cmd.substr(pos));
-			}
+// -----------------------------------------------
+// AtomSpace.haveAtom({ "type": "ConceptNode", "name": "foo"})
+HANDLER(do_have_atom)
+{
+	ARGS;
+	GET_ATOM("false");
+	RETURN("true");
+}
+
+// -----------------------------------------------
+// AtomSpace.makeAtom({ "type": "ConceptNode", "name": "foo"})
+// AtomSpace.makeAtom(
+//    {"outgoing":
+//       [{"type":"Concept","name":"start"},
+//       {"type":"Concept","name":"finish"}],
+//    "type":"EdgeLink"})
+HANDLER(do_make_atom)
+{
+	ARGS;
+	ADD_ATOM;
+	RETURN("true");
+}
+
+// -----------------------------------------------
+// AtomSpace.getIncoming({"type": "Concept", "name": "foo"})
+// AtomSpace.getIncoming({"type": "Concept", "name": "foo"}, "Evaluation")
+// AtomSpace.getIncoming({"type": "Concept", "name": "foo", "limit": 100})
+// AtomSpace.getIncoming({"cursor": "5f3e0a1b2c3d4e5f"})
+HANDLER(do_get_incoming)
+{
+	ARGS;
+	GET_PAGING;
+	GET_ATOM("[]");
+
+	Type t = NOTYPE;
+	pos = rq.positional ? cmd.find(",", epos) : std::string::npos;
+	if (std::string::npos != pos)
+	{
+		pos++;
+		try {
+			t = Json::decode_type(cmd, pos);
+		}
+		catch(...) {
+			return retmsgerr("Unknown type: " + quote(argtext(cmd, pos, rq)));
 		}
+	}
 
-		IncomingSet is;
+	Search search = [h, t](AtomSpace* asp) {
+		HandleSeq is;
 		if (NOTYPE != t)
 			is = h->getIncomingSetByType(t);
 		else
 			is = h->getIncomingSet();
+		return is;
+	};
+	return first_page(as, search, search(as), pg, js_mode);
+}
 
-		std::string atmlist;
-		if (js_mode)
-		{
-			bool first = true;
-			atmlist = "[";
-			for (const Handle& hi : is)
-			{
-				if (not first) { atmlist += ",\n"; } else { first = false; }
-				atmlist += Json::encode_atom(hi, "");
-			}
-			atmlist += "]";
-		}
-		else
-		{
-			atmlist = "(list ";
-			for (const Handle& hi : is)
-				atmlist += Sexpr::encode_atom(hi);
-			atmlist += ")";
-		}
-		RETURNSTR(atmlist);
-	}
+// -----------------------------------------------
+// AtomSpace.getKeys({ "type": "ConceptNode", "name": "foo"})
+HANDLER(do_get_keys)
+{
+	ARGS;
+	GET_ATOM("[]");
+	HandleSet keys = h->getKeys();
 
-	// -----------------------------------------------
-	// AtomSpace.getKeys({ "type": "ConceptNode", "name": "foo"})
-	if (gtkey == act)
+	if (js_mode)
 	{
-		GET_ATOM("[]");
-		HandleSet keys = h->getKeys();
-
-		std::string klist;
-		if (js_mode)
-		{
-			bool first = true;
-			klist = "[";
-			for (const Handle& key : keys)
-			{
-				if (not first) { klist += ",\n"; } else { first = false; }
-				klist += Json::encode_atom(key, "");
-			}
-			klist += "]";
-		}
-		else
+		BEGIN_REPLY;
+		rs.push_back('[');
+		bool first = true;
+		for (const Handle& key : keys)
 		{
-			klist = "(list ";
-			for (const Handle& key : keys)
-				klist += Sexpr::encode_atom(key);
-			klist += ")";
+			if (not first) { rs.push_back(','); } else { first = false; }
+			Json::encode_atom(rs, key, true);
 		}
-		RETURNSTR(klist);
+		rs.push_back(']');
+		END_REPLY;
 	}
 
-	// -----------------------------------------------
-	// AtomSpace.getValues({ "type": "ConceptNode", "name": "foo"})
-	if (gtval == act)
+	std::string klist = "(list ";
+	for (const Handle& key : keys)
+		klist += Sexpr::encode_atom(key);
+	klist += ")";
+	RETURNSTR(klist);
+}
+
+// -----------------------------------------------
+// AtomSpace.getValues({ "type": "ConceptNode", "name": "foo"})
+// AtomSpace.getValues({ "type": "ConceptNode", "name": "foo", "b64": true})
+HANDLER(do_get_values)
+{
+	ARGS;
+	GET_ATOM("[]");
+	GET_B64;
+	if (js_mode)
 	{
-		GET_ATOM("[]");
-		std::string result = js_mode ? Json::encode_atom_values(h) : Sexpr::encode_atom_values(h);
-		RETURNSTR(result);
+		BEGIN_REPLY;
+		Json::encode_atom_values(rs, h, true, b64);
+		END_REPLY;
 	}
+	RETURNSTR(Sexpr::encode_atom_values(h));
+}
 
-	// -----------------------------------------------
-	// AtomSpace.getValueAtKey({ "type": "ConceptNode", "name": "foo",
-	//                           "key": { "type": "PredicateNode", "name": "keewee" } })
-	// Returns the value at the specified key for the given atom
-	if (gtvak == act)
-	{
-		size_t save_pos = pos;
-		ADD_ATOM;
-		epos = save_pos;
-		GET_KEY;
+// -----------------------------------------------
+// AtomSpace.getValueAtKey({ "type": "ConceptNode", "name": "foo",
+//                           "key": { "type": "PredicateNode", "name": "keewee" } })
+// Returns the value at the specified key for the given atom.
+// Add "b64": true to get FloatValues and BoolValues in base64.
+HANDLER(do_get_value_at_key)
+{
+	ARGS;
+	ADD_ATOM;
+	GET_KEY;
+	GET_B64;
 
-		// Get the value at the key
-		ValuePtr v = h->getValue(k);
-		if (nullptr == v) RETURN("null");
+	// Get the value at the key
+	ValuePtr v = h->getValue(k);
+	if (nullptr == v) RETURN("null");
 
-		std::string result = js_mode ? Json::encode_value(v) : Sexpr::encode_value(v);
-		RETURNSTR(result);
+	if (js_mode)
+	{
+		BEGIN_REPLY;
+		Json::encode_value(rs, v, true, b64);
+		END_REPLY;
 	}
+	RETURNSTR(Sexpr::encode_value(v));
+}
 
-	// -----------------------------------------------
-	// AtomSpace.setValue({ "type": "ConceptNode", "name": "foo",
-	//     "key": { "type": "PredicateNode", "name": "keewee" },
-	//     "value": { "type": "FloatValue", "value": [1, 2, 3] } } )
-	// If all is well, then the member fields can occur in arbitrary
-	// order, so that the key can be given before the name, which can
-	// be given before the type.
-	if (stval == act)
+// -----------------------------------------------
+// AtomSpace.setValue({ "type": "ConceptNode", "name": "foo",
+//     "key": { "type": "PredicateNode", "name": "keewee" },
+//     "value": { "type": "FloatValue", "value": [1, 2, 3] } } )
+// If all is well, then the member fields can occur in arbitrary
+// order, so that the key can be given before the name, which can
+// be given before the type.
+HANDLER(do_set_value)
+{
+	ARGS;
+	ADD_ATOM;
+	GET_KEY;
+	GET_VALUE;
+
+	as->set_value(h, k, v);
+	RETURN("true");
+}
+
+// -----------------------------------------------
+// AtomSpace.execute({ "type": "PlusLink", "outgoing":
+//     [{ "type": "NumberNode", "name": "2" },
+//      { "type": "NumberNode", "name": "2" }] })
+HANDLER(do_execute)
+{
+	ARGS;
+	// try..catch is needed because the Atom might be a TriggerLink
+	// which will force execution, but then throw an exception with
+	// the result of execution in it.
+	ValuePtr vp;
+	try
 	{
-		size_t save_pos = pos;
 		ADD_ATOM;
-		epos = save_pos;
-		GET_KEY;
-		GET_VALUE;
-
-		as->set_value(h, k, v);
-		RETURN("true");
+		vp = h->execute();
 	}
+	catch (const ValueReturnException& ex)
+	{
+		vp = ex._value;
+	}
+	BEGIN_REPLY;
+	Json::encode_value(rs, vp, true);
+	END_REPLY;
+}
+
+// -----------------------------------------------
+// AtomSpace.extract({ "type": "Concept", "name": "foo"}, true)
+HANDLER(do_extract)
+{
+	ARGS;
+	Handle h = Json::decode_atom(cmd, rq.tape, ARG_OBJ);
+	if (nullptr == h) RETURN("false");
+	pos = rq.tape[0].end;
+	GET_BOOL;
+	bool ok = as->extract_atom(h, recursive);
+	if (ok) RETURN("true");
+	RETURN("false");
+}
+
+// -----------------------------------------------
+// AtomSpace.reportCounts()
+// Returns a list of atom types and their counts (non-zero only)
+HANDLER(do_report_counts)
+{
+	BEGIN_REPLY;
+	rs.push_back('{');
+	bool first = true;
+
+	// Get all types from the NameServer
+	std::vector<Type> all_types;
+	nameserver().getChildrenRecursive(ATOM, std::back_inserter(all_types));
 
-	// -----------------------------------------------
-	// AtomSpace.execute({ "type": "PlusLink", "outgoing":
-	//     [{ "type": "NumberNode", "name": "2" },
-	//      { "type": "NumberNode", "name": "2" }] })
-	if (execu == act)
+	// Iterate through all types and get counts
+	for (Type t : all_types)
 	{
-		// try..catch is needed because the Atom might be a TriggerLink
-		// which will force execution, but then throw an exception with
-		// the result of execution in it.
-		ValuePtr vp;
-		try
+		size_t count = as->get_num_atoms_of_type(t, false);
+		if (count > 0)
 		{
-			ADD_ATOM;
-			vp = h->execute();
+			if (not first) { rs.push_back(','); } else { first = false; }
+			rs += "\\\"";
+			rs += nameserver().getTypeName(t);
+			rs += "\\\":";
+			rs += std::to_string(count);
 		}
-		catch (const ValueReturnException& ex)
-		{
-			vp = ex._value;
-		}
-		std::string result = Json::encode_value(vp);
-		RETURNSTR(result);
 	}
+	rs.push_back('}');
+	END_REPLY;
+}
 
-	// -----------------------------------------------
-	// AtomSpace.extract({ "type": "Concept", "name": "foo"}, true)
-	if (extra == act)
-	{
-		Handle h = Json::decode_atom(cmd, pos, epos);
-		if (nullptr == h) RETURN("false");
-		pos = epos;
-		GET_BOOL;
-		bool ok = as->extract_atom(h, recursive);
-		if (ok) RETURN("true");
-		RETURN("false");
-	}
+// -----------------------------------------------
+// AtomSpace.batch([{"tool": "makeAtom", "params": {...}},
+//                  {"tool": "getValues", "params": {...}}])
+// { "tool": "batch", "params": {"calls": [{"tool": ..., "params": ...}]}}
+//
+// Run a list of tool calls, in order, and return all of the results
+// in one reply: {"results": [REPLY, REPLY, ...]}, in the same order as
+// the calls. Each REPLY is exactly what the call would have returned
+// by itself. A call that fails does not stop the ones after it; its
+// REPLY is the usual error. Batches cannot be nested.
+
+// Run one call in a batch. The `call` is the tape index of the
+// `{"tool": ..., "params": ...}` object.
+static std::string run_call(AtomSpace* as, const std::string& cmd,
+                            const JsonTape& tape, size_t call,
+                            bool js_mode)
+{
+	JSRequest rq;
+	rq.js_mode = js_mode;
+	if (not parse_call(cmd, tape, call, rq))
+		return retmsgerr("Expecting {\\\"tool\\\": ..., \\\"params\\\": {...}}");
 
-	// -----------------------------------------------
-	// AtomSpace.reportCounts()
-	// Returns a list of atom types and their counts (non-zero only)
-	if (rpcnt == act)
-	{
-		std::string rv = "{\n";
-		bool first = true;
+	std::string_view tool(cmd.data() + rq.tool, rq.tool_len);
+	if ("batch" == tool)
+		return retmsgerr("Batches cannot be nested");
+
+	JSHandler handler = find_handler(tool);
+	if (nullptr == handler)
+		return retmsgerr("Unknown tool: " + std::string(tool));
 
-		// Get all types from the NameServer
-		std::vector<Type> all_types;
-		nameserver().getChildrenRecursive(ATOM, std::back_inserter(all_types));
+	return handler(as, cmd, rq);
+}
 
-		// Iterate through all types and get counts
-		for (Type t : all_types)
+HANDLER(do_batch)
+{
+	// In JS-mode, the argument is the array itself. In MCP-mode,
+	// it is in the "calls" field.
+	JsonTape arg;
+	const JsonTape* tape = &rq.tape;
+	size_t calls = JsonTape::npos;
+	if (rq.obj)
+		calls = rq.tape.field(cmd, 0, "calls");
+	else
+	{
+		size_t apos = cmd.find_first_not_of(" \n\t", rq.pos);
+		if (std::string::npos != apos and arg.scan(cmd, apos))
 		{
-			size_t count = as->get_num_atoms_of_type(t, false);
-			if (count > 0)
-			{
-				if (not first) { rv += ",\n"; } else { first = false; }
-				rv += "  \"" + nameserver().getTypeName(t) + "\": " + std::to_string(count);
-			}
+			tape = &arg;
+			calls = 0;
 		}
-		rv += "\n}";
-		RETURNSTR(rv);
 	}
+	if (JsonTape::npos == calls or JsonToken::ARRAY != (*tape)[calls].kind)
+		return retmsgerr("Expecting an array of tool calls");
+
+	// Each reply is a complete object: {"content": [ITEM]}, perhaps
+	// with "isError" or "nextCursor" next to the content. Pass each
+	// along whole, so that none of these are lost.
+	std::string rs("{\"results\": [");
+	bool first = true;
+	for (size_t i = tape->begin(calls); i < tape->end(calls); i = (*tape)[i].next)
+	{
+		if (not first) { rs += ", "; } else { first = false; }
+
+		std::string reply;
+		if (JsonToken::OBJECT != (*tape)[i].kind)
+			reply = retmsgerr("Expecting a tool call");
+		else
+			reply = run_call(as, cmd, *tape, i, rq.js_mode);
+
+		while (not reply.empty() and '\n' == reply.back()) reply.pop_back();
+		rs += reply;
+	}
+	rs += "]}\n";
+	return rs;
+}
+
+// -----------------------------------------------
+
+/// The dispatch table. The keys are string_views of string literals,
+/// so lookup does not need to copy the tool name out of the command.
+static const std::unordered_map<std::string_view, JSHandler> dispatch_table =
+{
+	{"version",       do_version},
+	{"getAtoms",      do_get_atoms},
+	{"getSubTypes",   do_get_sub_types},
+	{"getSuperTypes", do_get_super_types},
+	{"haveNode",      do_have_node},
+	{"haveLink",      do_have_link},
+	{"haveAtom",      do_have_atom},
+	{"makeAtom",      do_make_atom},
+	{"getIncoming",   do_get_incoming},
+	{"getKeys",       do_get_keys},
+	{"getValues",     do_get_values},
+	{"getValueAtKey", do_get_value_at_key},
+	{"setValue",      do_set_value},
+	{"execute",       do_execute},
+	{"extract",       do_extract},
+	{"reportCounts",  do_report_counts},
+	{"batch",         do_batch},
+};
+
+static JSHandler find_handler(std::string_view tool)
+{
+	auto it = dispatch_table.find(tool);
+	if (dispatch_table.end() == it) return nullptr;
+	return it->second;
+}
+
+/// The cogserver provides a network API to send/receive Atoms, encoded
+/// as JSON, over the internet. This is NOT as efficient as the
+/// s-expression API, but is more convenient for web developers.
+//
+std::string JSCommands::interpret_command(AtomSpace* as,
+                                          const std::string& cmd)
+{
+	// Ignore comments, blank lines
+	size_t cpos = cmd.find_first_not_of(" \n\t");
+	if (std::string::npos == cpos) return "";
+	if ('/' == cmd[cpos]) return "";
+	if ('#' == cmd[cpos]) return "";
+
+	JSRequest rq;
+	if (not parse_envelope(cmd, cpos, rq))
+		return reterr(cmd);
+
+	JSHandler handler = find_handler(
+		std::string_view(cmd.data() + rq.tool, rq.tool_len));
+	if (nullptr == handler)
+		return reterr(cmd);
 
-	// -----------------------------------------------
-	return reterr(cmd);
+	return handler(as, cmd, rq);
 }
@@ -45,12 +45,15 @@ public:
 	///
 	/// Supported function calls:
 	///    AtomSpace.getAtoms(type, recursive)
+	///    AtomSpace.getAtoms({"type": type, "limit": n})
+	///    AtomSpace.getAtoms({"cursor": next})
 	///    AtomSpace.haveNode(type, name)
 	///    AtomSpace.haveLink(type, outgoing)
 	///    AtomSpace.haveAtom(atom)
 	///    AtomSpace.getIncoming(atom)
 	///    AtomSpace.getIncoming(atom, type)
 	///    AtomSpace.getValues(atom)
+	///    AtomSpace.batch([{"tool": name, "params": {...}}, ...])
 	///
 	/// So far, there aren't any commands to change the contents of
 	/// the atomspace, but there could be ... these aren't hard.
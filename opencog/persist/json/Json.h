@@ -25,6 +25,7 @@
 
 #include <string>
 #include <opencog/atoms/base/Handle.h>
+#include <opencog/persist/json/JsonTape.h>
 
 namespace opencog
 {
@@ -60,12 +61,56 @@ public:
 	static Type decode_type(const std::string& s, size_t& pos);
 	static Type decode_type_arg(const std::string& s, size_t& pos);
 
+	/// Decode from a JsonTape that was already scanned from `s`.
+	/// The `tok` is the tape index of the object (or, for the type,
+	/// of the type name). These do not rescan the input.
+	static Handle decode_atom(const std::string& s, const JsonTape&, size_t tok);
+	static ValuePtr decode_value(const std::string& s, const JsonTape&, size_t tok);
+	static Type decode_type(const std::string& s, const JsonTape&, size_t tok);
+
 	// -------------------------------------------
 	// Encoding functions
 	static std::string encode_atom(const Handle&, const std::string& = "");
 	static std::string encode_value(const ValuePtr&, const std::string& = "");
 	static std::string encode_atom_values(const Handle&);
 	static std::string encode_type_list(const std::vector<Type>&);
+
+	// -------------------------------------------
+	// Compact encoding functions. These append to `out`, print no
+	// whitespace, and print floats in the shortest form that reads
+	// back exactly. If `embed` is true, the output is escaped so that
+	// it can be placed directly inside of a JSON string (as in the
+	// MCP "text" replies), without having to quote it a second time.
+	//
+	// If `b64` is true, then FloatValues and BoolValues are sent as
+	// base64 of the raw little-endian doubles, or of the bits, packed
+	// eight to a byte, lowest bit first:
+	//    {"type":"FloatValue","b64":"AAAAAAAA8D8AAAAAAAAAQA=="}
+	//    {"type":"BoolValue","size":9,"b64":"jQE="}
+	// This is about a third of the size of the decimal text, and is
+	// much faster to decode. The decoders accept either form.
+	static void encode_atom(std::string& out, const Handle&, bool embed = false);
+	static void encode_value(std::string& out, const ValuePtr&,
+	                         bool embed = false, bool b64 = false);
+	static void encode_atom_values(std::string& out, const Handle&,
+	                               bool embed = false, bool b64 = false);
+	static void encode_type_list(std::string& out, const std::vector<Type>&, bool embed = false);
+
+	// Print the Atom, followed by all of its Values, as a single
+	// compact object:
+	//    {"type":"ConceptNode","name":"foo","values":[{"key":...,"value":...}]}
+	// The `vatom` version prints just the one Value, at `key`. These
+	// are the lines of the JSON-Lines files of the JsonStorageNode.
+	static void dump_atom(std::string& out, const Handle&, bool b64 = false);
+	static void dump_vatom(std::string& out, const Handle&, const Handle& key,
+	                       bool b64 = false);
+
+	static void append_double(std::string& out, double, bool embed = false);
+	static void append_quoted(std::string& out, const std::string&, bool embed = false);
+
+	static void append_base64(std::string& out, const char*, size_t);
+	static bool decode_base64(const std::string& s, size_t beg, size_t end,
+	                          std::string& out);
 };
 
 /** @}*/
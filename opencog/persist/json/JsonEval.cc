@@ -22,7 +22,9 @@
  */
 
 #include <chrono>
-#include <thread>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include <opencog/util/Logger.h>
 #include <opencog/atomspace/AtomSpace.h>
@@ -48,15 +50,30 @@ JsonEval::~JsonEval()
  */
 void JsonEval::eval_expr(const std::string &expr)
 {
+	AtomSpacePtr as(_atomspace.lock());
+	if (nullptr == as)
+	{
+		_error_string = "The AtomSpace has been deleted";
+		_caught_error = true;
+		return;
+	}
+
+	// Run the command without holding the lock, so that the reader
+	// can collect the replies to earlier commands in the meantime.
+	std::string reply;
 	try {
-		std::lock_guard<std::mutex> lock(_mtx);
-		_answer = JSCommands::interpret_command(_atomspace.get(), expr);
+		reply = JSCommands::interpret_command(as.get(), expr);
 	}
 	catch (const StandardException& ex)
 	{
 		_error_string = ex.what();
 		_caught_error = true;
 	}
+
+	// Append, don't overwrite: the replies to pipelined commands
+	// queue up, in order, until they are polled.
+	std::lock_guard<std::mutex> lock(_mtx);
+	_answer += reply;
 }
 
 std::string JsonEval::poll_result()
@@ -64,45 +81,30 @@ std::string JsonEval::poll_result()
 	std::string ret;
 	std::lock_guard<std::mutex> lock(_mtx);
 	ret.swap(_answer);
+	_drained.notify_all();
 	return ret;
 }
 
+/// Commands can be pipelined: a new one may start before the replies
+/// to the earlier ones have been collected. The only reason to wait is
+/// if the reader has fallen far behind; then wait for it to catch up,
+/// rather than buffering without bound. This never spins.
 void JsonEval::begin_eval()
 {
 	std::unique_lock<std::mutex> lock(_mtx);
-	if (_answer.empty()) return;
-
-	// Unusual race condition: some other thread is using this evaluator,
-	// and evaluation there has not completed. This seems to be rare,
-	// and I think we can just ignore this, at least for a little while.
-	auto start = std::chrono::steady_clock::now();
-	bool warned = false;
-	while (not _answer.empty())
-	{
-		// Release lock and yield so poll_result() can clear _answer
-		lock.unlock();
-		std::this_thread::yield();
-		lock.lock();
-
-		auto elapsed = std::chrono::steady_clock::now() - start;
-		auto secs = std::chrono::duration_cast<std::chrono::seconds>(elapsed).count();
-
-		// Warn if we've been waiting a long time (> 1 second)
-		if (not warned and secs >= 1)
-		{
-			logger().warn("JsonEval::begin_eval: Buffer not empty after 1 sec, size=%lu",
-				 _answer.size());
-			warned = true;
-		}
-
-		// Give up after 60 seconds - something is very wrong
-		if (secs >= 60)
-		{
-			logger().error("JsonEval::begin_eval: Giving up after 60 sec, size=%lu",
-				_answer.size());
-			return;
-		}
-	}
+	auto drained = [this]{ return _answer.size() < MAX_PENDING; };
+	if (drained()) return;
+
+	if (_drained.wait_for(lock, std::chrono::seconds(1), drained))
+		return;
+	logger().warn("JsonEval::begin_eval: Reader stalled for 1 sec, size=%lu",
+		 _answer.size());
+
+	// Give up after 60 seconds - something is very wrong
+	if (_drained.wait_for(lock, std::chrono::seconds(59), drained))
+		return;
+	logger().error("JsonEval::begin_eval: Giving up after 60 sec, size=%lu",
+		_answer.size());
 }
 
 /* ============================================================== */
@@ -116,17 +118,66 @@ void JsonEval::interrupt(void)
 	_error_string = "Caught interrupt!";
 }
 
+/// Give an idle evaluator a new AtomSpace. Returns false if there are
+/// replies that have not yet been collected.
+bool JsonEval::rebind(const AtomSpacePtr& as)
+{
+	std::lock_guard<std::mutex> lock(_mtx);
+	if (not _answer.empty()) return false;
+	_atomspace = as;
+	_caught_error = false;
+	_error_string.clear();
+	return true;
+}
+
+/// Each thread keeps its own pool of evaluators, one per AtomSpace,
+/// so that no locks are needed to find one. A thread that serves
+/// several AtomSpaces gets the right one for each, instead of the
+/// one for whichever AtomSpace it happened to see first.
+///
+/// The evaluators hold only weak pointers to their AtomSpaces. They
+/// are never deleted before the thread exits, as the caller (or the
+/// thread polling for results) may still be holding on to one, even
+/// after its AtomSpace is gone. Instead, idle evaluators whose
+/// AtomSpace is gone are handed out again, for new AtomSpaces; so the
+/// pool is never bigger than the number of AtomSpaces in use at once.
 JsonEval* JsonEval::get_evaluator(const AtomSpacePtr& as)
 {
-	static thread_local JsonEval* evaluator = new JsonEval(as);
+	static thread_local std::vector<std::unique_ptr<JsonEval>> pool;
+	static thread_local std::unordered_map<const AtomSpace*, JsonEval*> index;
+	static thread_local std::unique_ptr<JsonEval> unbound;
+
+	if (nullptr == as)
+	{
+		if (nullptr == unbound) unbound.reset(new JsonEval(as));
+		return unbound.get();
+	}
+
+	// The address of a deleted AtomSpace might be reused by a new
+	// one; the expired weak pointer tells them apart.
+	auto it = index.find(as.get());
+	if (index.end() != it and not it->second->_atomspace.expired())
+		return it->second;
 
-	// The eval_dtor runs when this thread is destroyed.
-	class eval_dtor {
-		public:
-		~eval_dtor() { delete evaluator; }
-	};
-	static thread_local eval_dtor killer;
+	// Forget the addresses of AtomSpaces that are gone.
+	for (auto si = index.begin(); si != index.end(); )
+	{
+		if (si->second->_atomspace.expired())
+			si = index.erase(si);
+		else
+			si++;
+	}
+
+	for (auto& ev : pool)
+	{
+		if (not ev->_atomspace.expired() or not ev->rebind(as)) continue;
+		index[as.get()] = ev.get();
+		return ev.get();
+	}
 
+	JsonEval* evaluator = new JsonEval(as);
+	pool.emplace_back(evaluator);
+	index[as.get()] = evaluator;
 	return evaluator;
 }
 
@@ -23,6 +23,8 @@
 #ifndef _OPENCOG_JSON_EVAL_H
 #define _OPENCOG_JSON_EVAL_H
 
+#include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <opencog/atomspace/AtomSpace.h>
@@ -44,7 +46,9 @@ class AtomSpace;
 class JsonEval : public GenericEval
 {
 	private:
-		AtomSpacePtr _atomspace;
+		// Weak, so that a pooled evaluator does not keep an
+		// AtomSpace alive after everyone else is done with it.
+		std::weak_ptr<AtomSpace> _atomspace;
 
 		// poll_result() is called in a different thread
 		// than eval_expr() and the result is that _answer
@@ -52,7 +56,13 @@ class JsonEval : public GenericEval
 		std::mutex _mtx;
 		std::string _answer;
 
+		// Replies from pipelined commands queue up in _answer. If the
+		// reader falls this far behind, begin_eval() waits for it.
+		static constexpr size_t MAX_PENDING = 64 * 1024 * 1024;
+		std::condition_variable _drained;
+
 		JsonEval(const AtomSpacePtr&);
+		bool rebind(const AtomSpacePtr&);
 	public:
 		virtual ~JsonEval();
 		virtual std::string get_name(void) const { return "JsonEval"; }
@@ -63,6 +73,11 @@ class JsonEval : public GenericEval
 
 		virtual void interrupt(void);
 
+		/// Return the evaluator for this thread and this AtomSpace.
+		/// Each thread gets a distinct evaluator for each AtomSpace
+		/// it works with. The pointer remains valid until the thread
+		/// exits; but once the AtomSpace is gone, the evaluator may be
+		/// handed out again, for some other AtomSpace.
 		static JsonEval* get_evaluator(const AtomSpacePtr&);
 };
 
@@ -0,0 +1,450 @@
+/*
+ * FUNCTION:
+ * JSON-Lines file-backed persistent storage.
+ *
+ * HISTORY:
+ * Copyright (c) 2026 OpenCog Foundation
+ *
+ * LICENSE:
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/persist/storage/storage_types.h>
+
+#include "Json.h"
+#include "JsonStorage.h"
+
+using namespace opencog;
+
+// The file is read in blocks of about this size, so that loading
+// does not need memory in proportion to the size of the file.
+#define LOAD_BLOCK (64*1024*1024)
+
+// Don't bother starting a thread for less than this much text.
+#define MIN_CHUNK (1024*1024)
+
+// Stored lines are written out in batches of about this size.
+#define STORE_BLOCK (1024*1024)
+
+JsonStorageNode::JsonStorageNode(Type t, const std::string& uri)
+	: StorageNode(t, uri)
+{
+	_already_loaded = false;
+	_fh = nullptr;
+
+	_filename = get_name();
+
+	// If the URL begins with `json://` then just strip that off.
+	if (0 == _filename.compare(0, 7, "json://"))
+		_filename = _filename.substr(7);
+}
+
+JsonStorageNode::~JsonStorageNode()
+{
+	if (_fh) fclose(_fh);
+	_fh = nullptr;
+}
+
+void JsonStorageNode::erase(void)
+{
+	if (not connected())
+		throw IOException(TRACE_INFO,
+		"JsonStorageNode %s is not open!", _filename.c_str());
+
+	int rc = ftruncate(fileno(_fh), 0);
+	if (rc)
+		throw IOException(TRACE_INFO,
+		"JsonStorageNode cannot erase %s: %s",
+			_filename.c_str(), strerror(errno));
+}
+
+void JsonStorageNode::kill_data(void)
+{
+	if (_fh) erase();
+	else
+	{
+		int rc = unlink(_filename.c_str());
+		if (rc)
+			throw IOException(TRACE_INFO,
+			"JsonStorageNode cannot remove %s: %s",
+				_filename.c_str(), strerror(errno));
+	}
+}
+
+void JsonStorageNode::open(void)
+{
+	if (_fh)
+		throw IOException(TRACE_INFO,
+		"JsonStorageNode %s is already open!", _filename.c_str());
+
+	_already_loaded = false;
+	_fh = fopen(_filename.c_str(), "a+");
+
+	// If we get a "Permission denied", then try again in read-only mode.
+	if (nullptr == _fh and (EPERM == errno or EACCES == errno))
+		_fh = fopen(_filename.c_str(), "r");
+
+	if (nullptr == _fh)
+		throw IOException(TRACE_INFO,
+		"JsonStorageNode cannot open %s: %s",
+			_filename.c_str(), strerror(errno));
+}
+
+void JsonStorageNode::close(void)
+{
+	if (_fh) fclose(_fh);
+	_fh = nullptr;
+	_already_loaded = false;
+}
+
+bool JsonStorageNode::connected(void)
+{
+	return nullptr != _fh;
+}
+
+void JsonStorageNode::barrier(AtomSpace*)
+{
+	if (_fh) fflush(_fh);
+}
+
+Handle JsonStorageNode::getNode(Type, const char *)
+{
+	throw IOException(TRACE_INFO,
+		"JsonStorageNode does not support this operation!");
+	return Handle::UNDEFINED;
+}
+
+Handle JsonStorageNode::getLink(Type, const HandleSeq&)
+{
+	throw IOException(TRACE_INFO,
+		"JsonStorageNode does not support this operation!");
+	return Handle::UNDEFINED;
+}
+
+void JsonStorageNode::fetchIncomingSet(AtomSpace* as, const Handle&)
+{
+	// Fake it.
+	return loadAtomSpace(as);
+}
+
+void JsonStorageNode::fetchIncomingByType(AtomSpace* as, const Handle&, Type)
+{
+	// Fake it.
+	return loadAtomSpace(as);
+}
+
+/// Write out the buffer with a single `fwrite()`, so that lines
+/// stored from different threads are not interleaved.
+void JsonStorageNode::write_line(std::string& buf)
+{
+	if (not connected())
+		throw IOException(TRACE_INFO,
+		"JsonStorageNode %s is not open!", _filename.c_str());
+
+	if (0 == buf.size()) return;
+	size_t rc = fwrite(buf.data(), buf.size(), 1, _fh);
+	buf.clear();
+
+	if (1 != rc)
+		throw IOException(TRACE_INFO,
+		"JsonStorageNode failed to store Atom at %s: %s",
+			_filename.c_str(), strerror(errno));
+}
+
+void JsonStorageNode::storeAtom(const Handle& h, bool synchronous)
+{
+	std::string line;
+	Json::dump_atom(line, h, true);
+	line.push_back('\n');
+	write_line(line);
+}
+
+void JsonStorageNode::removeAtom(AtomSpace* as, const Handle&, bool recursive)
+{
+	throw IOException(TRACE_INFO,
+		"JsonStorageNode does not support this operation!");
+}
+
+void JsonStorageNode::storeValue(const Handle& h, const Handle& key)
+{
+	std::string line;
+	Json::dump_vatom(line, h, key, true);
+	line.push_back('\n');
+	write_line(line);
+}
+
+// Same as storeValue(); the AtomSpace already holds the sum.
+void JsonStorageNode::updateValue(const Handle& h, const Handle& key,
+                                  const ValuePtr&)
+{
+	storeValue(h, key);
+}
+
+void JsonStorageNode::storeAtoms(const HandleSeq& atoms)
+{
+	std::string buf;
+	for (const Handle& h : atoms)
+	{
+		Json::dump_atom(buf, h, true);
+		buf.push_back('\n');
+		if (STORE_BLOCK < buf.size()) write_line(buf);
+	}
+	write_line(buf);
+}
+
+void JsonStorageNode::storeValues(
+	const std::vector<std::pair<Handle, Handle>>& atom_keys)
+{
+	std::string buf;
+	for (const std::pair<Handle, Handle>& ak : atom_keys)
+	{
+		Json::dump_vatom(buf, ak.first, ak.second, true);
+		buf.push_back('\n');
+		if (STORE_BLOCK < buf.size()) write_line(buf);
+	}
+	write_line(buf);
+}
+
+void JsonStorageNode::loadValue(const Handle&, const Handle&)
+{
+	throw IOException(TRACE_INFO,
+		"JsonStorageNode does not support this operation!");
+}
+
+void JsonStorageNode::loadType(AtomSpace* as, Type)
+{
+	// Fake it.
+	return loadAtomSpace(as);
+}
+
+void JsonStorageNode::storeAtomSpace(const AtomSpace* table)
+{
+	if (not connected())
+		throw IOException(TRACE_INFO,
+		"JsonStorageNode %s is not open!", _filename.c_str());
+
+	HandleSeq hset;
+	table->get_handles_by_type(hset, ATOM, true);
+
+	std::string buf;
+	for (const Handle& h: hset)
+	{
+		// Store roots, and Atoms that have values.
+		// All other Atoms will appear in outgoing sets.
+		if (not h->haveValues() and 0 != h->getIncomingSetSize())
+			continue;
+
+		Json::dump_atom(buf, h, true);
+		buf.push_back('\n');
+		if (STORE_BLOCK < buf.size()) write_line(buf);
+	}
+	write_line(buf);
+
+	fflush(_fh);
+}
+
+/* ================================================================== */
+// Loading.
+
+namespace {
+struct Setting
+{
+	Handle atom;
+	Handle key;
+	ValuePtr value;
+};
+}
+
+/// Decode the lines in `buf` from `beg` up to `end`, adding the Atoms
+/// to the AtomSpace as they are found. Atoms can be added in any order,
+/// and from any thread. The Values cannot: a later line must win over
+/// an earlier one. So they are only collected here, and are set later,
+/// in file order.
+static void load_lines(AtomSpace* as, const std::string& buf,
+                       size_t beg, size_t end, std::vector<Setting>& vals)
+{
+	JsonTape tape;
+	while (beg < end)
+	{
+		size_t eol = buf.find('\n', beg);
+		if (std::string::npos == eol or end < eol) eol = end;
+
+		// Skip blank lines.
+		size_t pos = buf.find_first_not_of(" \t\r", beg);
+		if (eol <= pos)
+		{
+			beg = eol + 1;
+			continue;
+		}
+
+		if (not tape.scan(buf, pos) or eol < tape[0].end)
+			throw SyntaxException(TRACE_INFO, "Bad JSON line: %s >>%s<<",
+				tape.error().c_str(), buf.substr(pos, eol - pos).c_str());
+
+		Handle h = Json::decode_atom(buf, tape, 0);
+		if (nullptr == h)
+			throw SyntaxException(TRACE_INFO, "Not an Atom >>%s<<",
+				buf.substr(pos, eol - pos).c_str());
+		h = as->add_atom(h);
+
+		size_t vals_pos = tape.field(buf, 0, "values");
+		if (JsonTape::npos == vals_pos)
+		{
+			beg = eol + 1;
+			continue;
+		}
+		if (JsonToken::ARRAY != tape[vals_pos].kind)
+			throw SyntaxException(TRACE_INFO, "Bad values >>%s<<",
+				buf.substr(pos, eol - pos).c_str());
+
+		for (size_t i = tape.begin(vals_pos); i < tape.end(vals_pos);
+		     i = tape[i].next)
+		{
+			Handle key = Json::decode_atom(buf, tape,
+				tape.field(buf, i, "key"));
+			size_t vpos = tape.field(buf, i, "value");
+			if (nullptr == key or JsonTape::npos == vpos)
+				throw SyntaxException(TRACE_INFO, "Bad key-value >>%s<<",
+					buf.substr(pos, eol - pos).c_str());
+
+			// A Value of `false` is an erased key.
+			ValuePtr vp;
+			if (JsonToken::OBJECT == tape[vpos].kind)
+			{
+				vp = Json::decode_value(buf, tape, vpos);
+				if (nullptr == vp)
+					throw SyntaxException(TRACE_INFO, "Bad value >>%s<<",
+						buf.substr(pos, eol - pos).c_str());
+				vp = as->add_atoms(vp);
+			}
+			vals.push_back({h, as->add_atom(key), vp});
+		}
+		beg = eol + 1;
+	}
+}
+
+/// Load the first `end` bytes of `buf`, which must end on a line
+/// boundary. The text is split into one piece per thread, at newlines.
+static void load_block(AtomSpace* as, const std::string& buf, size_t end)
+{
+	size_t nthreads = std::thread::hardware_concurrency();
+	nthreads = std::min(nthreads, end / MIN_CHUNK);
+	if (0 == nthreads) nthreads = 1;
+
+	std::vector<std::vector<Setting>> vals(nthreads);
+	if (1 == nthreads)
+		load_lines(as, buf, 0, end, vals[0]);
+	else
+	{
+		std::vector<size_t> cuts({0});
+		for (size_t i = 1; i < nthreads; i++)
+		{
+			size_t cut = buf.find('\n', i * end / nthreads);
+			cut = (std::string::npos == cut or end <= cut) ? end : cut + 1;
+			cuts.push_back(std::max(cut, cuts.back()));
+		}
+		cuts.push_back(end);
+
+		std::vector<std::exception_ptr> errs(nthreads);
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < nthreads; i++)
+			threads.push_back(std::thread([&, i]() {
+				try { load_lines(as, buf, cuts[i], cuts[i+1], vals[i]); }
+				catch (...) { errs[i] = std::current_exception(); }
+			}));
+		for (std::thread& thr : threads) thr.join();
+
+		for (const std::exception_ptr& ep : errs)
+			if (ep) std::rethrow_exception(ep);
+	}
+
+	for (const std::vector<Setting>& vs : vals)
+		for (const Setting& st : vs)
+			as->set_value(st.atom, st.key, st.value);
+}
+
+void JsonStorageNode::loadAtomSpace(AtomSpace* table)
+{
+	// Avoid reading twice.
+	if (_already_loaded) return;
+
+	// Check to see if it's connected, and then ignore the file handle.
+	if (not connected())
+		throw IOException(TRACE_INFO,
+		"JsonStorageNode %s is not open!", _filename.c_str());
+
+	FILE* fh = fopen(_filename.c_str(), "r");
+	if (nullptr == fh)
+		throw IOException(TRACE_INFO,
+			"JsonStorageNode cannot open %s: %s",
+			_filename.c_str(), strerror(errno));
+
+	// Read a block, load all of the whole lines in it, and keep the
+	// partial line at the end for the next go-around.
+	std::string buf;
+	try
+	{
+		while (true)
+		{
+			size_t have = buf.size();
+			buf.resize(have + LOAD_BLOCK);
+			size_t got = fread(&buf[have], 1, LOAD_BLOCK, fh);
+			buf.resize(have + got);
+			if (ferror(fh))
+				throw IOException(TRACE_INFO,
+					"JsonStorageNode cannot read %s: %s",
+					_filename.c_str(), strerror(errno));
+
+			if (0 == got)
+			{
+				// The last line does not need a newline.
+				if (buf.size()) load_block(table, buf, buf.size());
+				break;
+			}
+
+			size_t eol = buf.rfind('\n');
+			if (std::string::npos == eol) continue;
+			load_block(table, buf, eol + 1);
+			buf.erase(0, eol + 1);
+		}
+	}
+	catch (...)
+	{
+		fclose(fh);
+		throw;
+	}
+
+	fclose(fh);
+	_already_loaded = true;
+}
+
+DEFINE_NODE_FACTORY(JsonStorageNode, JSON_STORAGE_NODE)
+
+void opencog_persist_json_init(void)
+{
+   // Force shared lib ctors to run
+};
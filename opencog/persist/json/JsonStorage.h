@@ -0,0 +1,101 @@
+/*
+ * FUNCTION:
+ * JSON-Lines file-backed persistent storage.
+ *
+ * HISTORY:
+ * Copyright (c) 2026 OpenCog Foundation
+ *
+ * LICENSE:
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_JSON_STORAGE_H
+#define _OPENCOG_JSON_STORAGE_H
+
+#include <opencog/persist/api/StorageNode.h>
+
+namespace opencog
+{
+/** \addtogroup grp_persist
+ *  @{
+ */
+
+/// Read and write JSON-Lines files: one Atom, and its Values, per
+/// line, as printed by `Json::dump_atom()`. This is the JSON version
+/// of the FileStorageNode; it exists so that AtomSpace contents can be
+/// exchanged with tools that read JSON Lines (Spark, pandas, jq) but
+/// know nothing of s-expressions. FloatValues and BoolValues are
+/// written in base64, so that they are read back exactly as written.
+///
+/// Like the FileStorageNode, this is append-only: storing an Atom or a
+/// Value appends a line, and loading replays the lines in order, so
+/// that later Values win. The loader splits the file on newlines, and
+/// decodes the pieces in parallel.
+class JsonStorageNode : public StorageNode
+{
+	private:
+		std::string _filename;
+		FILE* _fh;
+		bool _already_loaded;
+
+		void write_line(std::string&);
+
+	public:
+		JsonStorageNode(Type t, const std::string& uri);
+		virtual ~JsonStorageNode();
+
+		void open(void);
+		void close(void);
+		bool connected(void); // connection to DB is alive
+
+		void kill_data(void);       // destroy DB contents
+		void create(void) { erase(); }
+		void destroy(void) { erase(); }
+		void erase(void);
+
+		// AtomStorage interface
+		Handle getNode(Type, const char *);
+		Handle getLink(Type, const HandleSeq&);
+		void fetchIncomingSet(AtomSpace*, const Handle&);
+		void fetchIncomingByType(AtomSpace*, const Handle&, Type t);
+		void storeAtom(const Handle&, bool synchronous = false);
+		void removeAtom(AtomSpace*, const Handle&, bool recursive);
+		void storeValue(const Handle&, const Handle&);
+		void updateValue(const Handle&, const Handle&, const ValuePtr&);
+		void storeAtoms(const HandleSeq&);
+		void storeValues(const std::vector<std::pair<Handle, Handle>>&);
+		void loadValue(const Handle&, const Handle&);
+		void loadType(AtomSpace*, Type);
+		void barrier(AtomSpace* = nullptr);
+
+		// Large-scale loads and saves
+		void loadAtomSpace(AtomSpace*); // Load entire contents of DB
+		void storeAtomSpace(const AtomSpace*); // Store all of AtomSpace
+
+		static Handle factory(const Handle&);
+};
+
+NODE_PTR_DECL(JsonStorageNode)
+#define createJsonStorageNode CREATE_DECL(JsonStorageNode)
+
+/** @}*/
+} // namespace opencog
+
+extern "C" {
+void opencog_persist_json_init(void);
+};
+
+#endif // _OPENCOG_JSON_STORAGE_H
@@ -0,0 +1,114 @@
+/*
+ * JsonTape.h
+ * Single-pass tokenizer for the JSON subset used by the AtomSpace.
+ *
+ * Copyright (C) 2026 OpenCog Foundation
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _JSON_TAPE_H
+#define _JSON_TAPE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace opencog
+{
+/** \addtogroup grp_persist
+ *  @{
+ */
+
+/// One token on the tape. Objects and arrays are a single token,
+/// followed by the tokens of their contents. Object contents alternate
+/// between a STRING key and its value.
+struct JsonToken
+{
+	enum Kind : uint8_t { OBJECT, ARRAY, STRING, BARE };
+
+	Kind kind;
+	size_t start;   // Offset of the first char (brace, bracket, quote).
+	size_t end;     // One past the last char.
+	size_t next;    // Tape index of the next sibling.
+};
+
+/// A flat, simdjson-style "tape" of tokens for a single JSON value.
+///
+/// The input is scanned exactly once, by a small state machine, and
+/// the tape records where each token starts and ends, and where its
+/// next sibling is. Nothing is copied out of the input string; strings
+/// are unescaped only when asked for. Looking up a field of an object
+/// skips over the values of all the other fields without looking at
+/// them, so that decoding a whole Atom is linear in the input size.
+///
+/// Bare words (numbers, `true`, `false`, `null`) are not checked
+/// during the scan; that is left to whoever converts them. Trailing
+/// commas in arrays and objects are accepted, because bad clients can
+/// (and do) send them.
+class JsonTape
+{
+	std::vector<JsonToken> _toks;
+	std::string _err;
+
+	bool fail(const char*, size_t);
+
+public:
+	static constexpr size_t npos = (size_t) -1;
+
+	/// Tokenize the JSON value starting at `pos` (leading whitespace
+	/// is skipped). Returns false if it is malformed or truncated;
+	/// `error()` then says why.
+	bool scan(const std::string& s, size_t pos);
+
+	const std::string& error(void) const { return _err; }
+	bool empty(void) const { return _toks.empty(); }
+	size_t size(void) const { return _toks.size(); }
+	const JsonToken& operator[](size_t i) const { return _toks[i]; }
+
+	/// The first child of a container, and one past the last.
+	size_t begin(size_t i) const { return i+1; }
+	size_t end(size_t i) const { return _toks[i].next; }
+
+	/// Return the tape index of the value of the named top-level field
+	/// of the object at `obj`, or `npos` if there is no such field.
+	size_t field(const std::string& s, size_t obj, const char* name) const;
+
+	/// The contents of a STRING token, with the escapes undone.
+	std::string get_string(const std::string& s, size_t i) const;
+
+	/// The contents of a STRING token, as-is, without the quotes.
+	std::string get_raw(const std::string& s, size_t i) const {
+		return s.substr(_toks[i].start + 1, _toks[i].end - _toks[i].start - 2);
+	}
+
+	/// True if the token is the bare word `true`.
+	bool is_true(const std::string& s, size_t i) const {
+		return JsonToken::BARE == _toks[i].kind and
+			0 == s.compare(_toks[i].start, _toks[i].end - _toks[i].start, "true");
+	}
+
+	/// Convert a BARE token to a double. Throws on garbage. The strings
+	/// "NaN", "Infinity" and "-Infinity" are accepted, too, as that is
+	/// how `Json::append_double()` writes them.
+	double get_double(const std::string& s, size_t i) const;
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _JSON_TAPE_H
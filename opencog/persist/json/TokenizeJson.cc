@@ -0,0 +1,307 @@
+/*
+ * TokenizeJson.cc
+ * Single-pass tokenizer for the JSON subset used by the AtomSpace.
+ *
+ * Copyright (C) 2026 OpenCog Foundation
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+#include <opencog/util/exceptions.h>
+
+#include "JsonTape.h"
+
+using namespace opencog;
+
+/* ================================================================== */
+
+bool JsonTape::fail(const char* msg, size_t pos)
+{
+	_err = msg;
+	_err += " at offset ";
+	_err += std::to_string(pos);
+	return false;
+}
+
+// Characters that end a bare word. The close-paren is here so that
+// the JS-mode `AtomSpace.foo(true)` works.
+static inline bool is_bare_end(char c)
+{
+	switch (c)
+	{
+		case ' ': case '\t': case '\n': case '\r':
+		case ',': case ':': case '"': case ')':
+		case '[': case ']': case '{': case '}':
+			return true;
+		default:
+			return false;
+	}
+}
+
+/// The state machine. The only state is what is wanted next, and the
+/// stack of open containers; the kind of container is on the tape.
+bool JsonTape::scan(const std::string& s, size_t pos)
+{
+	enum Want { VALUE, KEY, COLON, COMMA };
+
+	_toks.clear();
+	_err.clear();
+
+	std::vector<size_t> open;
+	Want want = VALUE;
+	size_t len = s.size();
+
+	while (pos < len)
+	{
+		char c = s[pos];
+		if (' ' == c or '\t' == c or '\n' == c or '\r' == c)
+		{
+			pos++;
+			continue;
+		}
+
+		// Close the innermost container. Empty containers, and
+		// trailing commas, are accepted here.
+		if ('}' == c or ']' == c)
+		{
+			if (open.empty()) return fail("Unexpected close", pos);
+			size_t t = open.back();
+			bool obj = (JsonToken::OBJECT == _toks[t].kind);
+			if (obj != ('}' == c)) return fail("Mismatched close", pos);
+			if (COLON == want or (obj and VALUE == want))
+				return fail("Missing value", pos);
+
+			_toks[t].end = pos + 1;
+			_toks[t].next = _toks.size();
+			open.pop_back();
+			pos++;
+			if (open.empty()) return true;
+			want = COMMA;
+			continue;
+		}
+
+		if (COMMA == want)
+		{
+			if (',' != c) return fail("Expecting a comma", pos);
+			want = (JsonToken::OBJECT == _toks[open.back()].kind) ?
+				KEY : VALUE;
+			pos++;
+			continue;
+		}
+
+		if (COLON == want)
+		{
+			if (':' != c) return fail("Expecting a colon", pos);
+			want = VALUE;
+			pos++;
+			continue;
+		}
+
+		if (KEY == want and '"' != c)
+			return fail("Expecting a quoted key", pos);
+
+		if ('{' == c or '[' == c)
+		{
+			open.push_back(_toks.size());
+			_toks.push_back({('{' == c) ? JsonToken::OBJECT : JsonToken::ARRAY,
+				pos, npos, npos});
+			want = ('{' == c) ? KEY : VALUE;
+			pos++;
+			continue;
+		}
+
+		if ('"' == c)
+		{
+			size_t p = pos + 1;
+			while (p < len and '"' != s[p])
+			{
+				if ('\\' == s[p]) p++;
+				p++;
+			}
+			if (len <= p) return fail("Unterminated string", pos);
+
+			_toks.push_back({JsonToken::STRING, pos, p+1, _toks.size()+1});
+			pos = p + 1;
+			if (KEY == want)
+			{
+				want = COLON;
+				continue;
+			}
+		}
+		else
+		{
+			if (is_bare_end(c)) return fail("Unexpected punctuation", pos);
+			size_t p = pos + 1;
+			while (p < len and not is_bare_end(s[p])) p++;
+			_toks.push_back({JsonToken::BARE, pos, p, _toks.size()+1});
+			pos = p;
+		}
+
+		// A scalar was just completed.
+		if (open.empty()) return true;
+		want = COMMA;
+	}
+
+	return fail("Truncated JSON", pos);
+}
+
+/* ================================================================== */
+
+size_t JsonTape::field(const std::string& s, size_t obj,
+                       const char* name) const
+{
+	if (JsonToken::OBJECT != _toks[obj].kind) return npos;
+
+	size_t nlen = strlen(name);
+	size_t i = begin(obj);
+	size_t e = end(obj);
+	while (i < e)
+	{
+		const JsonToken& key = _toks[i];
+		size_t val = key.next;
+		if (key.end - key.start == nlen + 2 and
+		    0 == s.compare(key.start + 1, nlen, name))
+			return val;
+		i = _toks[val].next;
+	}
+	return npos;
+}
+
+/* ================================================================== */
+
+static void put_utf8(std::string& out, uint32_t cp)
+{
+	if (cp < 0x80)
+		out.push_back((char) cp);
+	else if (cp < 0x800)
+	{
+		out.push_back((char) (0xc0 | (cp >> 6)));
+		out.push_back((char) (0x80 | (cp & 0x3f)));
+	}
+	else if (cp < 0x10000)
+	{
+		out.push_back((char) (0xe0 | (cp >> 12)));
+		out.push_back((char) (0x80 | ((cp >> 6) & 0x3f)));
+		out.push_back((char) (0x80 | (cp & 0x3f)));
+	}
+	else
+	{
+		out.push_back((char) (0xf0 | (cp >> 18)));
+		out.push_back((char) (0x80 | ((cp >> 12) & 0x3f)));
+		out.push_back((char) (0x80 | ((cp >> 6) & 0x3f)));
+		out.push_back((char) (0x80 | (cp & 0x3f)));
+	}
+}
+
+static bool get_hex4(const std::string& s, size_t p, size_t e, uint32_t& cp)
+{
+	if (e < p + 4) return false;
+	auto r = std::from_chars(s.data() + p, s.data() + p + 4, cp, 16);
+	return r.ec == std::errc() and r.ptr == s.data() + p + 4;
+}
+
+/// Undo the JSON escapes. Unknown escapes are passed through without
+/// the backslash, the same way that `std::quoted` does it.
+std::string JsonTape::get_string(const std::string& s, size_t i) const
+{
+	size_t p = _toks[i].start + 1;
+	size_t e = _toks[i].end - 1;
+
+	std::string out;
+	out.reserve(e - p);
+	while (p < e)
+	{
+		size_t bs = s.find('\\', p);
+		if (std::string::npos == bs or e <= bs)
+		{
+			out.append(s, p, e - p);
+			break;
+		}
+		out.append(s, p, bs - p);
+		p = bs + 1;
+
+		char c = s[p++];
+		switch (c)
+		{
+			case 'b': out.push_back('\b'); break;
+			case 'f': out.push_back('\f'); break;
+			case 'n': out.push_back('\n'); break;
+			case 'r': out.push_back('\r'); break;
+			case 't': out.push_back('\t'); break;
+			case 'u':
+			{
+				uint32_t cp;
+				if (not get_hex4(s, p, e, cp))
+				{
+					out.push_back('u');
+					break;
+				}
+				p += 4;
+
+				// Surrogate pairs.
+				uint32_t lo;
+				if (0xd800 <= cp and cp < 0xdc00 and
+				    p + 1 < e and '\\' == s[p] and 'u' == s[p+1] and
+				    get_hex4(s, p+2, e, lo) and
+				    0xdc00 <= lo and lo < 0xe000)
+				{
+					cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+					p += 6;
+				}
+				put_utf8(out, cp);
+				break;
+			}
+			default: out.push_back(c); break;
+		}
+	}
+	return out;
+}
+
+/* ================================================================== */
+
+double JsonTape::get_double(const std::string& s, size_t i) const
+{
+	const JsonToken& tok = _toks[i];
+	if (JsonToken::STRING == tok.kind)
+	{
+		size_t len = tok.end - tok.start;
+		if (0 == s.compare(tok.start, len, "\"NaN\""))
+			return std::numeric_limits<double>::quiet_NaN();
+		if (0 == s.compare(tok.start, len, "\"Infinity\""))
+			return std::numeric_limits<double>::infinity();
+		if (0 == s.compare(tok.start, len, "\"-Infinity\""))
+			return -std::numeric_limits<double>::infinity();
+	}
+
+	const char* beg = s.data() + tok.start;
+	const char* fin = s.data() + tok.end;
+	if (JsonToken::BARE == tok.kind and beg < fin and '+' == *beg) beg++;
+
+	double d = 0.0;
+	auto r = std::from_chars(beg, fin, d);
+	if (JsonToken::BARE != tok.kind or
+	    r.ec != std::errc() or r.ptr != fin)
+		throw SyntaxException(TRACE_INFO, "Not a number >>%s<<",
+			s.substr(tok.start, tok.end - tok.start).c_str());
+	return d;
+}
+
+/* ============================= END OF FILE ================= */
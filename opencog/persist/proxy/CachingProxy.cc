@@ -20,7 +20,12 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <opencog/util/Logger.h>
+#include <opencog/atoms/core/NumberNode.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atomspace/AtomSpace.h>
 #include <opencog/persist/proxy/CachingProxy.h>
+#include <opencog/persist/proxy/RamSize.h>
 #include <opencog/persist/storage/storage_types.h>
 
 using namespace opencog;
@@ -41,24 +46,406 @@ CachingProxy::~CachingProxy()
 {
 }
 
+// Don't bother sweeping stale entries out of `_fetched` until there
+// are at least this many.
+#define SWEEP_MIN 1000
+
 void CachingProxy::init(void)
 {
+	_lru_bytes = 0;
+	_max_atoms = 0;
+	_max_bytes = 0;
+	_nevicted = 0;
+	_ttl = 0.0;
+	_serve_stale = false;
+	_nstale = 0;
+	_nrefetched = 0;
+	_sweep_at = SWEEP_MIN;
+	_stop = false;
+}
+
+void CachingProxy::setValue(const Handle& key, const ValuePtr& value)
+{
+	// Pass it on.
+	ReadThruProxy::setValue(key, value);
+
+	// If we don't understand the message, just ignore it.
+	if (PREDICATE_NODE != key->get_type()) return;
+
+	const std::string& pred = key->get_name();
+	if (0 == pred.compare("*-cache-ttl-*"))
+	{
+		// Either (NumberNode secs) for the default, or
+		// (LinkValue key (NumberNode secs)) for just one key.
+		Handle tkey;
+		ValuePtr vp = value;
+		if (value->is_type(LINK_VALUE))
+		{
+			const ValueSeq& vs = LinkValueCast(value)->value();
+			if (2 == vs.size() and vs[0]->is_atom())
+			{
+				tkey = HandleCast(vs[0]);
+				vp = vs[1];
+			}
+		}
+		if (not vp->is_type(NUMBER_NODE))
+			throw SyntaxException(TRACE_INFO,
+				"Expecting TTL in a NumberNode, optionally with a key, got %s",
+				value->to_short_string().c_str());
+
+		NumberNodePtr nnp = NumberNodeCast(vp);
+		double secs = nnp->get_value();
+		if (secs < 0.0) secs = 0.0;
+
+		std::lock_guard<std::mutex> lck(_ttl_mtx);
+		if (tkey) _key_ttl[tkey] = secs;
+		else _ttl = secs;
+		return;
+	}
+
+	if (0 == pred.compare("*-serve-stale-*"))
+	{
+		// Non-zero to use stale Values while refetching them.
+		if (not value->is_type(NUMBER_NODE))
+			throw SyntaxException(TRACE_INFO,
+				"Expecting a NumberNode, got %s",
+				value->to_short_string().c_str());
+
+		NumberNodePtr nnp = NumberNodeCast(value);
+		_serve_stale = (0.0 != nnp->get_value());
+		return;
+	}
+
+	bool atoms = (0 == pred.compare("*-cache-atoms-*"));
+	bool bytes = (0 == pred.compare("*-cache-bytes-*"));
+	if (not atoms and not bytes) return;
+
+	if (not value->is_type(NUMBER_NODE))
+		throw SyntaxException(TRACE_INFO,
+			"Expecting cache size in a NumberNode, got %s",
+			value->to_short_string().c_str());
+
+	NumberNodePtr nnp = NumberNodeCast(value);
+	double sz = nnp->get_value();
+	size_t lim = (0.0 < sz) ? (size_t) sz : 0;
+	if (atoms) _max_atoms = lim;
+	else _max_bytes = lim;
+
+	// No limits, no need to keep track.
+	if (not tracking())
+		clear_lru();
+	else
+		evict();
 }
 
-// XXX TODO Add support for expiration times, limited AtomSpace
-// size and whatever other whizzy caching ideas we might want.
 void CachingProxy::open(void)
 {
 	_nhits = 0;
 	_nmisses = 0;
+	_nevicted = 0;
+	_nstale = 0;
+	_nrefetched = 0;
+	clear_lru();
+	{
+		std::lock_guard<std::mutex> lck(_ttl_mtx);
+		_fetched.clear();
+		_sweep_at = SWEEP_MIN;
+	}
 	ReadThruProxy::open();
+	_stop = false;
 }
 
 void CachingProxy::close(void)
 {
+	// Stop refetching; anything still waiting is dropped. It was
+	// stale anyway.
+	{
+		std::lock_guard<std::mutex> lck(_refetch_mtx);
+		_stop = true;
+	}
+	_refetch_cv.notify_all();
+	if (_refetch_thread.joinable())
+		_refetch_thread.join();
+	_stale_queue.clear();
+
 	ReadThruProxy::close();
+	clear_lru();
+}
+
+// ==============================================================
+
+void CachingProxy::clear_lru(void)
+{
+	std::lock_guard<std::mutex> lck(_lru_mtx);
+	_lru.clear();
+	_lru_index.clear();
+	_lru_bytes = 0;
+}
+
+bool CachingProxy::over_budget(void)
+{
+	return (0 < _max_atoms and _max_atoms < _lru.size()) or
+		(0 < _max_bytes and _max_bytes < _lru_bytes);
+}
+
+// Move the Atom to the front of the list, or put it there, if it's
+// not there yet. Its size is re-estimated, as Values may have been
+// fetched since the last time. Returns true if now over budget.
+bool CachingProxy::remember(const Handle& h)
+{
+	size_t bytes = atom_value_bytes(h);
+	std::lock_guard<std::mutex> lck(_lru_mtx);
+	auto it = _lru_index.find(h);
+	if (_lru_index.end() == it)
+	{
+		_lru.push_front(h);
+		_lru_index[h] = {_lru.begin(), bytes};
+	}
+	else
+	{
+		_lru.splice(_lru.begin(), _lru, it->second.pos);
+		_lru_bytes -= it->second.bytes;
+		it->second.bytes = bytes;
+	}
+	_lru_bytes += bytes;
+	return over_budget();
+}
+
+// Remember the Atom, and everything under it. The outgoing set goes
+// first, so that a Link is warmer than the Atoms it holds; they can't
+// be extracted before it is, anyway.
+bool CachingProxy::remember_tree(const Handle& h)
+{
+	if (h->is_link())
+		for (const Handle& ho : h->getOutgoingSet())
+			remember_tree(ho);
+	return remember(h);
+}
+
+// Remember all of the Atoms in a Value, such as a query result.
+bool CachingProxy::remember_value(const ValuePtr& vp)
+{
+	if (nullptr == vp) return false;
+
+	bool over = false;
+	if (vp->is_atom())
+		over = remember_tree(HandleCast(vp));
+	else if (vp->is_type(LINK_VALUE))
+		for (const ValuePtr& v : LinkValueCast(vp)->value())
+			over = remember_value(v) or over;
+	return over;
+}
+
+void CachingProxy::touch(const Handle& h)
+{
+	if (not tracking()) return;
+	if (remember(h)) evict();
+}
+
+void CachingProxy::touch_tree(const Handle& h)
+{
+	if (not tracking()) return;
+	if (remember_tree(h)) evict();
+}
+
+// The Atom, and its incoming set, along with everything that the
+// incoming set holds; all of it came from the target.
+void CachingProxy::touch_incoming(AtomSpace* as, const Handle& h)
+{
+	if (not tracking()) return;
+	bool over = remember(h);
+	for (const Handle& hi : h->getIncomingSet(as))
+		over = remember_tree(hi) or over;
+	if (over) evict();
+}
+
+// Extract the coldest Atoms from the AtomSpace, until under budget.
+// An Atom that still has an incoming set cannot be extracted without
+// taking the incoming set with it. It is left where it is, at the cold
+// end of the list, and warmer Atoms are tried instead; if those include
+// its incoming set, another pass gets it. The warmest Atom, the one
+// just fetched, is never extracted; it is about to be used.
+void CachingProxy::evict(void)
+{
+	std::unique_lock<std::shared_mutex> elck(_evict_mtx);
+	std::lock_guard<std::mutex> lck(_lru_mtx);
+	bool progress = true;
+	while (progress and over_budget() and 1 < _lru.size())
+	{
+		progress = false;
+		auto it = _lru.end();
+		while (over_budget() and std::next(_lru.begin()) != it)
+		{
+			--it;
+			Handle h(*it);
+			AtomSpace* as = h->getAtomSpace();
+
+			// Someone else may have got it already.
+			if (nullptr != as)
+			{
+				if (not as->extract_atom(h)) continue;
+				_nevicted++;
+				std::lock_guard<std::mutex> tlck(_ttl_mtx);
+				_fetched.erase(h);
+			}
+
+			auto ix = _lru_index.find(h);
+			_lru_bytes -= ix->second.bytes;
+			_lru_index.erase(ix);
+			it = _lru.erase(it);
+			progress = true;
+		}
+	}
+}
+
+// ==============================================================
+
+bool CachingProxy::expiring(void)
+{
+	std::lock_guard<std::mutex> lck(_ttl_mtx);
+	return 0.0 < _ttl or not _key_ttl.empty();
+}
+
+// Caller must hold the lock.
+double CachingProxy::ttl(const Handle& key)
+{
+	auto it = _key_ttl.find(key);
+	if (_key_ttl.end() != it) return it->second;
+	return _ttl;
 }
 
+// Record a fetch. An undefined key means all of the Values; each key
+// that the Atom has after the fetch is recorded.
+void CachingProxy::stamp(const Handle& atom, const Handle& key)
+{
+	if (not expiring()) return;
+
+	HandleSet keys;
+	if (key) keys.insert(key);
+	else keys = atom->getKeys();
+
+	Stamp now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lck(_ttl_mtx);
+	KeyStamps& ks = _fetched[atom];
+	for (const Handle& k : keys)
+		ks[k] = now;
+
+	// Atoms extracted by evict() are erased there; but others may
+	// extract Atoms, too. Don't keep those around forever.
+	if (_fetched.size() < _sweep_at) return;
+	for (auto it = _fetched.begin(); it != _fetched.end(); )
+	{
+		if (nullptr == it->first->getAtomSpace())
+			it = _fetched.erase(it);
+		else
+			it++;
+	}
+	_sweep_at = 2 * _fetched.size() + SWEEP_MIN;
+}
+
+// A Value is fresh if it was fetched within its TTL. Values that
+// were never fetched (they may have been set locally, or fetched
+// before the TTL was set) have nothing to expire, and are fresh.
+bool CachingProxy::fresh(const Handle& atom, const Handle& key)
+{
+	std::lock_guard<std::mutex> lck(_ttl_mtx);
+	double secs = ttl(key);
+	if (0.0 >= secs) return true;
+
+	auto it = _fetched.find(atom);
+	if (_fetched.end() == it) return true;
+	auto kit = it->second.find(key);
+	if (it->second.end() == kit) return true;
+
+	std::chrono::duration<double> age =
+		std::chrono::steady_clock::now() - kit->second;
+	return age.count() < secs;
+}
+
+// An Atom is fresh if all of its Values are.
+bool CachingProxy::fresh(const Handle& atom)
+{
+	if (not expiring()) return true;
+	for (const Handle& key : atom->getKeys())
+		if (not fresh(atom, key)) return false;
+	return true;
+}
+
+// Queue a stale Value (or Atom, if the key is undefined) for refetch.
+// If it's already in the queue, this is a no-op.
+void CachingProxy::revalidate(const Handle& atom, const Handle& key)
+{
+	_nstale++;
+	_stale_queue.insert({atom, key});
+
+	// Most caches never serve stale Values, and so never need the
+	// refetch thread; start it the first time. Take the lock, so that
+	// it cannot race close(), nor miss the wakeup.
+	{
+		std::lock_guard<std::mutex> lck(_refetch_mtx);
+		if (not _stop and not _refetch_thread.joinable())
+			_refetch_thread = std::thread(&CachingProxy::refetch_loop, this);
+	}
+	_refetch_cv.notify_one();
+}
+
+// The Atom must not be evicted while it is being fetched; so hold
+// off evict() until done. Then touch it: it was just used. That may
+// evict, so it can't be done while evict() is held off.
+void CachingProxy::refetch(const Handle& atom, const Handle& key)
+{
+	{
+		std::shared_lock<std::shared_mutex> lck(_evict_mtx);
+
+		// Evicted while waiting. Not needed any more.
+		if (nullptr == atom->getAtomSpace()) return;
+
+		if (key)
+			ReadThruProxy::loadValue(atom, key);
+		else
+			ReadThruProxy::getAtom(atom);
+		stamp(atom, key);
+	}
+	touch(atom);
+	_nrefetched++;
+}
+
+#define REFETCH_BATCH 100
+
+void CachingProxy::refetch_loop(void)
+{
+	auto woken = [this] { return _stop or not _stale_queue.is_empty(); };
+
+	std::unique_lock<std::mutex> lck(_refetch_mtx);
+	while (not _stop)
+	{
+		_refetch_cv.wait(lck, woken);
+		lck.unlock();
+
+		while (not _stop)
+		{
+			std::vector<std::pair<Handle,Handle>> batch =
+				_stale_queue.try_get(REFETCH_BATCH);
+			if (batch.empty()) break;
+
+			// Errors can't be thrown back to anyone; the stale Value
+			// stays, and will be tried again, next time it is read.
+			for (const auto& pr : batch)
+			{
+				try { refetch(pr.first, pr.second); }
+				catch (const std::exception& ex)
+				{
+					logger().warn("CachingProxy: Refetch failed: %s",
+						ex.what());
+				}
+			}
+		}
+		lck.lock();
+	}
+}
+
+// ==============================================================
+
 #define CHECK_OPEN if (not ReadThruProxy::connected()) return;
 
 // Conceptually, we want to do this (or something like this):
@@ -74,45 +461,73 @@ void CachingProxy::close(void)
 //
 // The alternative is to keep an std::set or an std::unordered_set of
 // everything we've fetched before. But this eats a little bit of RAM,
-// and is slower than the checks done below. But we will need to do
-// that, sooner or later, if we want to have time-stamps to expire old
-// atoms. Whatever, that's a future design.
+// and is slower than the checks done below. It is done only when
+// Values can go stale; then the fetch times are needed anyway.
 
 void CachingProxy::getAtom(const Handle& h)
 {
 	CHECK_OPEN;
 
-	if (h->haveValues()) { _nhits++; return; }
+	if (h->haveValues())
+	{
+		if (fresh(h)) { _nhits++; touch(h); return; }
+		if (_serve_stale)
+		{
+			revalidate(h, Handle::UNDEFINED);
+			touch(h);
+			return;
+		}
+	}
 
 	_nmisses ++;
 	ReadThruProxy::getAtom(h);
+	stamp(h, Handle::UNDEFINED);
+	touch_tree(h);
 }
 
 void CachingProxy::fetchIncomingSet(AtomSpace* as, const Handle& h)
 {
 	CHECK_OPEN;
-	if (0 < h->getIncomingSetSize(as)) { _nhits++; return; }
+	if (0 < h->getIncomingSetSize(as)) { _nhits++; touch(h); return; }
 
 	_nmisses ++;
 	ReadThruProxy::fetchIncomingSet(as, h);
+	touch_incoming(as, h);
 }
 
 void CachingProxy::fetchIncomingByType(AtomSpace* as, const Handle& h, Type t)
 {
 	CHECK_OPEN;
-	if (0 < h->getIncomingSetSizeByType(t, as)) { _nhits++; return; }
+	if (0 < h->getIncomingSetSizeByType(t, as)) { _nhits++; touch(h); return; }
 
 	_nmisses ++;
 	ReadThruProxy::fetchIncomingByType(as, h, t);
+	touch_incoming(as, h);
 }
 
 void CachingProxy::loadValue(const Handle& atom, const Handle& key)
 {
 	CHECK_OPEN;
-	if (nullptr != atom->getValue(key)) { _nhits++; return; }
+	if (nullptr != atom->getValue(key))
+	{
+		if (fresh(atom, key)) { _nhits++; touch(atom); return; }
+		if (_serve_stale)
+		{
+			revalidate(atom, key);
+			touch(atom);
+			return;
+		}
+	}
 
 	_nmisses ++;
 	ReadThruProxy::loadValue(atom, key);
+	stamp(atom, key);
+	if (not tracking()) return;
+
+	// The Value may hold Atoms that were not here before.
+	bool over = remember_value(atom->getValue(key));
+	over = remember_tree(atom) or over;
+	if (over) evict();
 }
 
 // We're just going to be unconditional, here.
@@ -121,6 +536,27 @@ void CachingProxy::loadType(AtomSpace* as, Type t)
 	CHECK_OPEN;
 	_nmisses ++;
 	ReadThruProxy::loadType(as, t);
+	if (not tracking()) return;
+
+	HandleSeq hset;
+	as->get_handles_by_type(hset, t);
+	bool over = false;
+	for (const Handle& h : hset)
+		over = remember_tree(h) or over;
+	if (over) evict();
+}
+
+// The query is run by the base class, which fetches through the
+// methods above; but the results land at the key, unseen by them.
+void CachingProxy::runQuery(const Handle& query, const Handle& key,
+                            const Handle& meta, bool fresh)
+{
+	ReadThruProxy::runQuery(query, key, meta, fresh);
+	if (not tracking()) return;
+
+	bool over = remember_value(query->getValue(key));
+	over = remember_tree(query) or over;
+	if (over) evict();
 }
 
 std::string CachingProxy::monitor(void)
@@ -129,9 +565,31 @@ std::string CachingProxy::monitor(void)
 	rpt += to_short_string().substr(1);
 	rpt.pop_back();
 	rpt += ":";
-	rpt += "   hits: " + std::to_string(_nhits);
-	rpt += "   misses: " + std::to_string(_nmisses);
+	rpt += "   hits: " + std::to_string(_nhits.load());
+	rpt += "   misses: " + std::to_string(_nmisses.load());
+	rpt += "   evicted: " + std::to_string(_nevicted.load());
 	rpt += "\n";
+	if (expiring())
+	{
+		std::lock_guard<std::mutex> lck(_ttl_mtx);
+		rpt += "TTL: " + std::to_string(_ttl);
+		rpt += "   per-key TTLs: " + std::to_string(_key_ttl.size());
+		rpt += "   stale: " + std::to_string(_nstale.load());
+		rpt += "   refetched: " + std::to_string(_nrefetched.load());
+		rpt += "   waiting: " + std::to_string(_stale_queue.size());
+		rpt += "\n";
+	}
+	if (tracking())
+	{
+		std::lock_guard<std::mutex> lck(_lru_mtx);
+		rpt += "Cached atoms: " + std::to_string(_lru.size());
+		rpt += "   max: " + (0 < _max_atoms ?
+			std::to_string(_max_atoms.load()) : std::string("none"));
+		rpt += "   est. bytes: " + std::to_string(_lru_bytes);
+		rpt += "   max: " + (0 < _max_bytes ?
+			std::to_string(_max_bytes.load()) : std::string("none"));
+		rpt += "\n";
+	}
 	return rpt;
 }
 
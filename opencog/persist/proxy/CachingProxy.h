@@ -23,6 +23,15 @@
 #ifndef _OPENCOG_CACHING_PROXY_H
 #define _OPENCOG_CACHING_PROXY_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <opencog/util/concurrent_set.h>
 #include <opencog/persist/proxy/ReadThruProxy.h>
 
 namespace opencog
@@ -34,14 +43,84 @@ class CachingProxy : public ReadThruProxy
 {
 private:
 	void init(void);
-	size_t _nhits;
-	size_t _nmisses;
+	std::atomic<size_t> _nhits;
+	std::atomic<size_t> _nmisses;
+
+protected:
+	// Least-recently-used list of the Atoms fetched through this proxy,
+	// most recent first, with the estimated size of each. This includes
+	// the Atoms that came along with them: outgoing sets, incoming sets
+	// and query results. When over budget, the coldest Atoms are
+	// extracted from the AtomSpace. The budget is in Atoms, or in bytes,
+	// or both; zero means no limit, and if there are no limits, nothing
+	// is tracked.
+	struct LruEntry
+	{
+		std::list<Handle>::iterator pos;
+		size_t bytes;
+	};
+	std::mutex _lru_mtx;
+	std::shared_mutex _evict_mtx;    // Shared while refetching.
+	std::list<Handle> _lru;
+	std::unordered_map<Handle, LruEntry> _lru_index;
+	size_t _lru_bytes;
+	std::atomic<size_t> _max_atoms;
+	std::atomic<size_t> _max_bytes;
+	std::atomic<size_t> _nevicted;
+	bool tracking(void) { return 0 < _max_atoms or 0 < _max_bytes; }
+	bool over_budget(void);
+	bool remember(const Handle&);
+	bool remember_tree(const Handle&);
+	bool remember_value(const ValuePtr&);
+	void touch(const Handle&);
+	void touch_tree(const Handle&);
+	void touch_incoming(AtomSpace*, const Handle&);
+	void evict(void);
+	void clear_lru(void);
+
+	// The time of the last fetch of each Value, whether fetched singly,
+	// or together with the rest of the Atom. Values older than their
+	// time-to-live are stale, and are fetched again; Values that were
+	// never fetched never go stale. The TTL can be set per key, with a
+	// default for all other keys; zero means the Values never go stale,
+	// and if nothing can go stale, nothing is recorded. Entries for
+	// Atoms extracted by others are swept out now and then.
+	typedef std::chrono::steady_clock::time_point Stamp;
+	typedef std::unordered_map<Handle, Stamp> KeyStamps;
+	std::mutex _ttl_mtx;
+	std::unordered_map<Handle, KeyStamps> _fetched;
+	size_t _sweep_at;
+	std::unordered_map<Handle, double> _key_ttl;
+	double _ttl;
+	bool expiring(void);
+	double ttl(const Handle&);
+	bool fresh(const Handle&);
+	bool fresh(const Handle&, const Handle&);
+	void stamp(const Handle&, const Handle&);
+
+	// Stale-while-revalidate. If set, stale Values are used as-is, and
+	// a background thread fetches them again. The queue holds (atom,
+	// key) pairs; an undefined key asks for all of the Values. The
+	// thread is started the first time that a stale Value is served.
+	std::atomic<bool> _serve_stale;
+	std::atomic<size_t> _nstale;
+	std::atomic<size_t> _nrefetched;
+	concurrent_set<std::pair<Handle,Handle>> _stale_queue;
+	std::thread _refetch_thread;
+	std::mutex _refetch_mtx;
+	std::condition_variable _refetch_cv;
+	std::atomic<bool> _stop;
+	void revalidate(const Handle&, const Handle&);
+	void refetch_loop(void);
+	void refetch(const Handle&, const Handle&);
 
 public:
 	CachingProxy(const std::string&&);
 	CachingProxy(Type t, const std::string&&);
 	virtual ~CachingProxy();
 
+	virtual void setValue(const Handle& key, const ValuePtr& value);
+
 	// ----------------------------------------------------------------
 	virtual void open(void);
 	virtual void close(void);
@@ -55,6 +134,8 @@ protected:
 	virtual void fetchIncomingByType(AtomSpace*, const Handle&, Type);
 	virtual void loadValue(const Handle& atom, const Handle& key);
 	virtual void loadType(AtomSpace*, Type);
+	virtual void runQuery(const Handle&, const Handle&,
+	                      const Handle& = Handle::UNDEFINED, bool = false);
 
 	virtual std::string monitor(void);
 
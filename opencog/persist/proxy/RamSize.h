@@ -0,0 +1,89 @@
+/*
+ * opencog/persist/proxy/RamSize.h
+ *
+ * Copyright (C) 2026 OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_RAM_SIZE_H
+#define _OPENCOG_RAM_SIZE_H
+
+#include <opencog/atoms/base/Atom.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+
+namespace opencog
+{
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+// Estimates of the RAM used by Atoms and Values, for the proxies that
+// have memory budgets. These are rough; the point is to be cheap.
+
+/// Rough size of an Atom: the Atom itself, and its name or outgoing
+/// set. The Values on it are not included.
+static inline size_t atom_bytes(const Handle& h)
+{
+	if (h->is_node())
+		return sizeof(Atom) + h->get_name().size();
+	return sizeof(Atom) + h->get_arity() * sizeof(Handle);
+}
+
+/// Rough size of a Value. Atoms held in Values are counted in full,
+/// even though they are usually shared.
+static inline size_t value_bytes(const ValuePtr& vp)
+{
+	if (nullptr == vp) return 0;
+	if (vp->is_atom())
+		return atom_bytes(HandleCast(vp));
+
+	if (vp->is_type(STRING_VALUE))
+	{
+		size_t sz = sizeof(StringValue);
+		for (const std::string& s : StringValueCast(vp)->value())
+			sz += sizeof(std::string) + s.size();
+		return sz;
+	}
+
+	if (vp->is_type(LINK_VALUE))
+	{
+		size_t sz = sizeof(LinkValue);
+		for (const ValuePtr& v : LinkValueCast(vp)->value())
+			sz += sizeof(ValuePtr) + value_bytes(v);
+		return sz;
+	}
+
+	// FloatValues and BoolValues and the like.
+	return sizeof(FloatValue) + vp->size() * sizeof(double);
+}
+
+/// Rough size of an Atom, together with all of its Values.
+static inline size_t atom_value_bytes(const Handle& h)
+{
+	size_t sz = atom_bytes(h);
+	for (const Handle& key : h->getKeys())
+		sz += sizeof(Handle) + sizeof(ValuePtr) + value_bytes(h->getValue(key));
+	return sz;
+}
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_RAM_SIZE_H
@@ -0,0 +1,124 @@
+/*
+ * RateController.cc
+ *
+ * Copyright (C) 2026 OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <math.h>
+
+#include <opencog/util/oc_assert.h>
+#include <opencog/persist/proxy/RateController.h>
+
+using namespace opencog;
+
+// Weight given to the newest latency measurement.
+#define GAIN 0.25
+
+// Additive increase, as a fraction of the writes possible in one tick.
+#define STEP 0.1
+
+RateController::RateController(double slo)
+{
+	_min_batch = 1000;
+	_min_mark = 1000;
+	_max_mark = 64123123;   // approx 4GBytes
+	_cut = 0.7;
+	set_slo(slo);
+	reset();
+}
+
+void RateController::set_slo(double slo)
+{
+	OC_ASSERT(0.0 < slo, "Latency target must be positive, got %g", slo);
+	_slo = slo;
+
+	// Write-outs happen at least every ten seconds.
+	_tick = 0.25 * _slo;
+	if (10.0 < _tick) _tick = 10.0;
+}
+
+void RateController::set_limits(size_t min_mark, size_t max_mark)
+{
+	_min_mark = min_mark;
+	_max_mark = max_mark;
+	if (_mark < _min_mark) _mark = _min_mark;
+	if (_max_mark < _mark) _mark = _max_mark;
+}
+
+void RateController::reset(void)
+{
+	_cost = 0.0;
+	_mark = _max_mark;
+	_ncuts = 0;
+}
+
+size_t RateController::batch_size(size_t queued) const
+{
+	// Drain with a time constant equal to the SLO. Don't dribble out
+	// the tail; if it's small, push it all out.
+	size_t nwrite = ceil(queued * _tick / _slo);
+	if (nwrite < _min_batch) nwrite = _min_batch;
+
+	// But not more than the target can take in one tick.
+	if (0.0 < _cost)
+	{
+		size_t most = _tick / _cost;
+		if (most < 1) most = 1;
+		if (most < nwrite) nwrite = most;
+	}
+	if (queued < nwrite) nwrite = queued;
+	return nwrite;
+}
+
+void RateController::update(size_t queued, size_t written, double secs)
+{
+	if (0 < written and 0.0 < secs)
+	{
+		double cost = secs / written;
+		if (0.0 == _cost)
+			_cost = cost;
+		else
+			_cost = (1.0 - GAIN) * _cost + GAIN * cost;
+	}
+
+	// Nothing written yet; nothing known.
+	if (0.0 == _cost) return;
+
+	// Little's law: the number of writes that can be made within
+	// the SLO. More than this in the queue means late writes.
+	double limit = _slo / _cost;
+
+	double mark = _mark;
+	if (limit < queued)
+	{
+		mark *= _cut;
+		if (limit < mark) mark = limit;
+		_ncuts ++;
+	}
+	else
+	{
+		double step = STEP * _tick / _cost;
+		if (step < 1.0) step = 1.0;
+		mark += step;
+	}
+
+	if (mark < _min_mark) mark = _min_mark;
+	if (_max_mark < mark) mark = _max_mark;
+	_mark = mark;
+}
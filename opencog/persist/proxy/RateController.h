@@ -0,0 +1,102 @@
+/*
+ * opencog/persist/proxy/RateController.h
+ *
+ * Copyright (C) 2026 OpenCog Foundation
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_RATE_CONTROLLER_H
+#define _OPENCOG_RATE_CONTROLLER_H
+
+#include <cstddef>
+
+namespace opencog
+{
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/// Flow control for the WriteBufferProxy.
+///
+/// The buffer is drained once every `tick()` seconds. Each drain writes
+/// a fraction of the queue, so that, left alone, the queue empties out
+/// exponentially, with a time constant equal to the latency target
+/// (the SLO). Writes that sit in the buffer longer are more likely to
+/// be overwritten by later writes, and so need never be sent at all;
+/// writes that sit longer than the SLO are late.
+///
+/// The high-water mark is the queue size at which producers must wait.
+/// It is set by AIMD (additive-increase, multiplicative-decrease), using
+/// the measured write latency of the target. The latency, per write, is
+/// averaged over the drains; with it, the time needed to write out the
+/// whole queue can be estimated. If that is more than the SLO, the
+/// target is falling behind: the mark is cut by a constant factor, and
+/// never left above the number of writes that can be made within the
+/// SLO (Little's law). Batches are kept to what can be written in one
+/// tick, so a slow target is not made slower by oversize writes; but
+/// this means that a late drain is not, in itself, a signal. Otherwise,
+/// the mark is raised by a tenth of what the target can write in one
+/// tick. Under overload, the mark saws up and down around the SLO
+/// limit; under light load, it climbs out of the way.
+///
+/// This class does no I/O and keeps no clock; the caller measures and
+/// reports. This keeps it deterministic, so that it can be tested with
+/// a simulated target.
+class RateController
+{
+private:
+	double _slo;          // Target latency, seconds.
+	double _tick;         // Time between drains, seconds.
+	size_t _min_batch;    // Smallest useful write.
+	size_t _max_mark;     // Largest allowed high-water mark.
+	size_t _min_mark;     // Smallest allowed high-water mark.
+	double _cut;          // Multiplicative decrease factor.
+
+	double _cost;         // Average seconds per write; zero if unknown.
+	size_t _mark;         // The high-water mark.
+	size_t _ncuts;        // Number of decreases, so far.
+
+public:
+	RateController(double slo = 60.0);
+
+	/// Set the latency target, in seconds. This also sets the tick.
+	void set_slo(double);
+	void set_min_batch(size_t n) { _min_batch = n; }
+	void set_limits(size_t min_mark, size_t max_mark);
+
+	/// Forget everything learned about the target.
+	void reset(void);
+
+	double slo(void) const { return _slo; }
+	double tick(void) const { return _tick; }
+	size_t high_water_mark(void) const { return _mark; }
+	double cost(void) const { return _cost; }
+	size_t cuts(void) const { return _ncuts; }
+
+	/// The number of writes to make in this drain, out of `queued`.
+	size_t batch_size(size_t queued) const;
+
+	/// Report a drain: `queued` writes were waiting after the batch was
+	/// taken, `written` of them were made, taking `secs` seconds.
+	void update(size_t queued, size_t written, double secs);
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_RATE_CONTROLLER_H
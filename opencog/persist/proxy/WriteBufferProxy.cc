@@ -21,23 +21,45 @@
  */
 
 #include <chrono>
+#include <errno.h>
+#include <exception>
 #include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <opencog/atoms/core/NumberNode.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+#include <opencog/persist/proxy/RamSize.h>
 #include <opencog/persist/proxy/WriteBufferProxy.h>
+#include <opencog/persist/sexpr/Sexpr.h>
 #include <opencog/persist/storage/storage_types.h>
 
 using namespace opencog;
 
+// Histogram buckets: seconds to write one batch, and the number of
+// Atoms plus Values waiting, at each drain.
+#define BATCH_SECS_BUCKETS \
+	{0.001, 0.003, 0.01, 0.03, 0.1, 0.3, 1.0, 3.0, 10.0, 30.0}
+#define QUEUE_DEPTH_BUCKETS \
+	{10.0, 100.0, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8}
+
 WriteBufferProxy::WriteBufferProxy(const std::string&& name) :
-	WriteThruProxy(WRITE_BUFFER_PROXY_NODE, std::move(name))
+	WriteThruProxy(WRITE_BUFFER_PROXY_NODE, std::move(name)),
+	_batch_secs(BATCH_SECS_BUCKETS),
+	_queue_depth(QUEUE_DEPTH_BUCKETS)
 {
 	init();
 }
 
 WriteBufferProxy::WriteBufferProxy(Type t, const std::string&& name) :
-	WriteThruProxy(t, std::move(name))
+	WriteThruProxy(t, std::move(name)),
+	_batch_secs(BATCH_SECS_BUCKETS),
+	_queue_depth(QUEUE_DEPTH_BUCKETS)
 {
 	init();
 }
@@ -50,9 +72,20 @@ void WriteBufferProxy::init(void)
 {
 	// Default decay time of 60 seconds
 	_decay = 60.0;
-#define HIMAX 64123123   // approx 4GBytes
-	_high_water_mark = HIMAX;
+	_high_water_mark = _rate.high_water_mark();
+	_write_secs = _rate.cost();
+	_mark_cuts = _rate.cuts();
+	_nwriters = 1;
+	_mem_budget = 0;
 	_stop = false;
+	_nwaiting = 0;
+	_spill_fh = nullptr;
+	_spilling = false;
+	_spill_read = 0;
+	_spill_restore = 0;
+	_ordered = false;
+	_log_seq = 0;
+	_log_size = 0;
 	reset_stats();
 }
 
@@ -62,20 +95,101 @@ void WriteBufferProxy::setValue(const Handle& key, const ValuePtr& value)
 	ProxyNode::setValue(key, value);
 
 	// If we don't understand the message, just ignore it.
-	if (PREDICATE_NODE != key->get_type() or
-	    0 != key->get_name().compare("*-decay-const-*"))
+	if (PREDICATE_NODE != key->get_type()) return;
+
+	const std::string& pred = key->get_name();
+	if (0 == pred.compare("*-decay-const-*"))
 	{
+		// Save the time decay const.
+		if (not value->is_type(NUMBER_NODE))
+			throw SyntaxException(TRACE_INFO,
+				"Expecting decay time in a NumberNode, got %s",
+				value->to_short_string().c_str());
+
+		NumberNodePtr nnp = NumberNodeCast(value);
+		double decay = nnp->get_value();
+		if (not (0.0 < decay))
+			throw SyntaxException(TRACE_INFO,
+				"Decay time must be positive, got %s",
+				value->to_short_string().c_str());
+		_decay = decay;
 		return;
 	}
 
-	// Save the time decay const.
-	if (not value->is_type(NUMBER_NODE))
-		throw SyntaxException(TRACE_INFO,
-			"Expecting decay time in a NumberNode, got %s",
-			value->to_short_string().c_str());
+	if (0 == pred.compare("*-memory-budget-*"))
+	{
+		// Max bytes to hold in the queues; zero for no limit.
+		if (not value->is_type(NUMBER_NODE))
+			throw SyntaxException(TRACE_INFO,
+				"Expecting memory budget in a NumberNode, got %s",
+				value->to_short_string().c_str());
+
+		NumberNodePtr nnp = NumberNodeCast(value);
+		double mb = nnp->get_value();
+		_mem_budget = (0.0 < mb) ? (size_t) mb : 0;
+		wake_producers();
+		return;
+	}
 
-	NumberNodePtr nnp = NumberNodeCast(value);
-	_decay = nnp->get_value();
+	if (0 == pred.compare("*-drain-threads-*"))
+	{
+		// Number of threads that write to the targets.
+		if (not value->is_type(NUMBER_NODE))
+			throw SyntaxException(TRACE_INFO,
+				"Expecting number of threads in a NumberNode, got %s",
+				value->to_short_string().c_str());
+
+		NumberNodePtr nnp = NumberNodeCast(value);
+		double nw = nnp->get_value();
+		_nwriters = (1.0 < nw) ? (size_t) nw : 1;
+		return;
+	}
+
+	if (0 == pred.compare("*-ordered-*"))
+	{
+		// Non-zero to write in the same order as stored.
+		if (not value->is_type(NUMBER_NODE))
+			throw SyntaxException(TRACE_INFO,
+				"Expecting a NumberNode, got %s",
+				value->to_short_string().c_str());
+
+		// The log and the queues can't both be in use.
+		if (_drain_thread.joinable())
+			throw SyntaxException(TRACE_INFO,
+				"Cannot change the write order while open");
+
+		NumberNodePtr nnp = NumberNodeCast(value);
+		_ordered = (0.0 != nnp->get_value());
+		return;
+	}
+
+	if (0 == pred.compare("*-spill-file-*"))
+	{
+		// Path to the overflow file. Takes effect on the next open.
+		if (value->is_type(STRING_VALUE))
+			_spill_name = StringValueCast(value)->value()[0];
+		else if (value->is_node())
+			_spill_name = HandleCast(value)->get_name();
+		else
+			throw SyntaxException(TRACE_INFO,
+				"Expecting a file name in a StringValue or Node, got %s",
+				value->to_short_string().c_str());
+		return;
+	}
+}
+
+ValuePtr WriteBufferProxy::getValue(const Handle& key) const
+{
+	if (PREDICATE_NODE == key->get_type())
+	{
+		WriteBufferProxy* self = const_cast<WriteBufferProxy*>(this);
+		const std::string& pred = key->get_name();
+		if (0 == pred.compare("*-metrics-*"))
+			return self->metrics_value();
+		if (0 == pred.compare("*-prometheus-*"))
+			return createStringValue(self->prometheus());
+	}
+	return WriteThruProxy::getValue(key);
 }
 
 void WriteBufferProxy::open(void)
@@ -84,7 +198,14 @@ void WriteBufferProxy::open(void)
 	WriteThruProxy::open();
 
 	// Reset the high-water mark.
-	_high_water_mark = HIMAX;
+	_rate.reset();
+	_high_water_mark = _rate.high_water_mark();
+	_write_secs = _rate.cost();
+	_mark_cuts = _rate.cuts();
+	_atom_bytes_in = 0;
+	_atoms_in = 0;
+	_value_bytes_in = 0;
+	_values_in = 0;
 
 	// Remove all previous pending writes (if any).
 	// This can happen if this was open for reading previously,
@@ -92,13 +213,31 @@ void WriteBufferProxy::open(void)
 	// was closed before the writes flushed. Not sure how this
 	// can happen, but safety first ...
 	_atom_queue.clear();
-	_value_queue.clear();
+	{
+		std::lock_guard<std::mutex> lck(_vidx_mtx);
+		_value_queue.clear();
+		_value_index.clear();
+	}
+	{
+		std::lock_guard<std::mutex> lck(_delta_mtx);
+		_deltas.clear();
+	}
+	{
+		std::lock_guard<std::mutex> lck(_log_mtx);
+		_log.clear();
+		_log_index.clear();
+		_log_size = 0;
+	}
 
 	// Open the queues
 	_atom_queue.open();
 	_value_queue.open();
 
+	// Pick up anything left in the spill file.
+	open_spill();
+
 	// Start the writer.
+	reset_stats();
 	_stop = false;
 	_drain_thread = std::thread(&WriteBufferProxy::drain_loop, this);
 }
@@ -109,39 +248,134 @@ void WriteBufferProxy::close(void)
 	_atom_queue.close();
 	_value_queue.close();
 
-	// Stop draining. The drain thread may be sleeping, so the join()
-	// might hang for a fraction of _ticker seconds. It does not seem
-	// worthwhile to try to speed this up, e.g. with a condition variable.
-	_stop = true;
+	// Stop draining. Wake the drain thread, if it's sleeping, and
+	// any producers that are stalled.
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		_stop = true;
+	}
+	_drain_cv.notify_all();
+	_room_cv.notify_all();
 	_drain_thread.join();
 
-	// Drain the queues
+	// Drain the queues, and the spill file.
 	barrier();
+	close_spill();
 
 	WriteThruProxy::close();
 }
 
+// Bytes per queue entry: the set node, and the Handles in it.
+#define ENTRY_BYTES 64
+
 void WriteBufferProxy::storeAtom(const Handle& h, bool synchronous)
 {
+	drop_deltas(h);
 	if (synchronous)
 	{
 		WriteThruProxy::storeAtom(h, synchronous);
 		return;
 	}
-	_atom_queue.insert(h);
+	if (must_spill())
+	{
+		spill_atoms({h});
+		return;
+	}
+	if (_ordered)
+		log_atoms({h});
+	else
+		_atom_queue.insert(h);
 	_astore ++;
+	_atom_bytes_in += ENTRY_BYTES + atom_bytes(h);
+	_atoms_in ++;
 
 	// Stall if oversize
-	if (_high_water_mark < _atom_queue.size())
+	if (overfull()) stall();
+}
+
+void WriteBufferProxy::storeAtoms(const HandleSeq& atoms)
+{
+	if (must_spill())
+	{
+		for (const Handle& h : atoms)
+			drop_deltas(h);
+		spill_atoms(atoms);
+		return;
+	}
+
+	size_t nbytes = 0;
+	for (const Handle& h : atoms)
 	{
-		_nstalls ++;
-		sleep(_ticker);
+		drop_deltas(h);
+		nbytes += ENTRY_BYTES + atom_bytes(h);
 	}
+	if (_ordered)
+		log_atoms(atoms);
+	else
+		for (const Handle& h : atoms)
+			_atom_queue.insert(h);
+	_astore += atoms.size();
+	_atom_bytes_in += nbytes;
+	_atoms_in += atoms.size();
+
+	if (overfull()) stall();
+}
+
+bool WriteBufferProxy::overfull(void)
+{
+	if (_high_water_mark < _atom_queue.size() or
+	    _high_water_mark < _value_queue.size() or
+	    _high_water_mark < _log_size)
+		return true;
+
+	size_t budget = _mem_budget;
+	return 0 < budget and budget < queued_bytes();
+}
+
+// Estimate of the RAM held by the queues. The queues hold Handles, so
+// the Atoms and Values are kept alive by them; count those, too.
+size_t WriteBufferProxy::queued_bytes(void)
+{
+	size_t na = _atoms_in;
+	size_t nv = _values_in;
+	size_t bytes = 0;
+	if (0 < na) bytes += _atom_queue.size() * (_atom_bytes_in / na);
+	if (0 < nv) bytes += _value_queue.size() * (_value_bytes_in / nv);
+	if (0 < na + nv)
+		bytes += _log_size * ((_atom_bytes_in + _value_bytes_in) / (na + nv));
+	return bytes;
+}
+
+// Block until the drain thread has brought the queues back under the
+// high-water mark. The drain thread is told that someone is waiting,
+// so that it starts writing right away, instead of finishing its nap.
+void WriteBufferProxy::stall(void)
+{
+	_nstalls ++;
+	std::unique_lock<std::mutex> lck(_mtx);
+	_nwaiting ++;
+	_drain_cv.notify_one();
+	_room_cv.wait(lck, [this] { return _stop or not overfull(); });
+	_nwaiting --;
+}
+
+// The queues got shorter, or the high-water mark went up. Taking the
+// lock, even briefly, avoids a lost wakeup between a producer checking
+// `overfull()` and starting to wait.
+void WriteBufferProxy::wake_producers(void)
+{
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+	}
+	_room_cv.notify_all();
 }
 
 void WriteBufferProxy::erase_recursive(const Handle& h)
 {
 	_atom_queue.erase(h);
+	drop_values(h);
+	drop_deltas(h);
+	drop_log(h);
 	IncomingSet ris(h->getIncomingSet());
 	for (const Handle& hi : ris)
 		erase_recursive(hi);
@@ -150,80 +384,670 @@ void WriteBufferProxy::erase_recursive(const Handle& h)
 void WriteBufferProxy::removeAtom(AtomSpace* as, const Handle& h,
                                      bool recursive)
 {
+	// Pending writes for the doomed Atom(s) are pointless; drop them.
 	if (recursive)
 		erase_recursive(h);
 	else
 	{
 		_atom_queue.erase(h);
+		drop_values(h);
+		drop_deltas(h);
+		drop_log(h);
 	}
+	wake_producers();
 
-	// There is no effective way of doing a remove from the value queue,
-	// because we don't have the associated key. (We could try looping,
-	// but that would be a huge waste of CPU). So instead, just flush
-	// the queue. We could ask the user to call barrier(), but the user
-	// might forget, so we do it for them.
-	if (not _value_queue.is_empty())
-	{
-		size_t bufsz = _value_queue.size();
-		std::vector<std::pair<Handle, Handle>> vav =
-			_value_queue.try_get(bufsz);
-		for (const std::pair<Handle, Handle>& kvp : vav)
-			WriteThruProxy::storeValue(kvp.first, kvp.second);
-
-		WriteThruProxy::barrier();
-	}
+	// Let any batch that's being written finish first.
+	std::lock_guard<std::mutex> blck(_batch_mtx);
 	WriteThruProxy::removeAtom(as, h, recursive);
 }
 
 void WriteBufferProxy::storeValue(const Handle& atom, const Handle& key)
 {
-	_value_queue.insert({atom, key});
+	drop_deltas(atom, key);
+	if (must_spill())
+	{
+		spill_values({{atom, key}});
+		return;
+	}
+	if (_ordered)
+		log_values({{atom, key}});
+	else
+	{
+		std::lock_guard<std::mutex> lck(_vidx_mtx);
+		_value_queue.insert({atom, key});
+		_value_index[atom].insert(key);
+	}
 	_vstore ++;
+	_value_bytes_in += ENTRY_BYTES + value_bytes(atom->getValue(key));
+	_values_in ++;
 
 	// Stall if oversize
-	if (_high_water_mark < _value_queue.size())
+	if (overfull()) stall();
+}
+
+void WriteBufferProxy::storeValues(
+	const std::vector<std::pair<Handle, Handle>>& atom_keys)
+{
+	if (must_spill())
+	{
+		for (const std::pair<Handle, Handle>& ak : atom_keys)
+			drop_deltas(ak.first, ak.second);
+		spill_values(atom_keys);
+		return;
+	}
+
+	size_t nbytes = 0;
+	for (const std::pair<Handle, Handle>& ak : atom_keys)
 	{
-		_nstalls ++;
-		sleep(_ticker);
+		drop_deltas(ak.first, ak.second);
+		nbytes += ENTRY_BYTES + value_bytes(ak.first->getValue(ak.second));
 	}
+	if (_ordered)
+		log_values(atom_keys);
+	else
+	{
+		std::lock_guard<std::mutex> lck(_vidx_mtx);
+		for (const std::pair<Handle, Handle>& ak : atom_keys)
+		{
+			_value_queue.insert(ak);
+			_value_index[ak.first].insert(ak.second);
+		}
+	}
+	_vstore += atom_keys.size();
+	_value_bytes_in += nbytes;
+	_values_in += atom_keys.size();
+
+	if (overfull()) stall();
+}
+
+// Pull up to `nget` Values off the queue, and out of the index.
+std::vector<std::pair<Handle, Handle>>
+WriteBufferProxy::take_values(size_t nget, bool reverse)
+{
+	std::lock_guard<std::mutex> lck(_vidx_mtx);
+	std::vector<std::pair<Handle, Handle>> vav =
+		_value_queue.try_get(nget, reverse);
+	for (const std::pair<Handle, Handle>& kvp : vav)
+	{
+		auto ki = _value_index.find(kvp.first);
+		if (_value_index.end() == ki) continue;
+		ki->second.erase(kvp.second);
+		if (ki->second.empty()) _value_index.erase(ki);
+	}
+	return vav;
+}
+
+void WriteBufferProxy::drop_values(const Handle& atom)
+{
+	std::lock_guard<std::mutex> lck(_vidx_mtx);
+	auto ki = _value_index.find(atom);
+	if (_value_index.end() == ki) return;
+	for (const Handle& key : ki->second)
+		_value_queue.erase({atom, key});
+	_value_index.erase(ki);
 }
 
 void WriteBufferProxy::updateValue(const Handle& atom, const Handle& key,
                                    const ValuePtr& delta)
 {
-	// XXX FIXME. Buffering these naively, like this, voilates the
-	// intent of how this method should work. However, for the
-	// RocksStorageNode, doing this is harmless. And the
-	// CogStorageNode is just a pass-through. So there are no
-	// existing StorageNodes that actually depend on delta.
-	// (The Value at key has already been atomically incremented,
-	// by the time we get here.) So just buffer these like regular
-	// storeValue() calls. This may result in incorrect behavior
-	// in some futuristic scenario that involves StorageNodes that
-	// don't yet exist. But I'm not gonna write complicated code to
-	// handle some hypothetical future case that may never exist.
-	storeValue(atom, key);
+	// The Value at key has already been atomically incremented, by
+	// the time we get here. Only plain FloatValue deltas can be summed;
+	// anything else is buffered like a regular storeValue(), which
+	// writes out the incremented Value. So is a missing delta, and so
+	// is everything in ordered mode, where deltas would jump the queue.
+	if (_ordered or nullptr == delta or FLOAT_VALUE != delta->get_type())
+	{
+		storeValue(atom, key);
+		return;
+	}
+
+	const std::vector<double>& dv = FloatValueCast(delta)->value();
+	std::lock_guard<std::mutex> lck(_delta_mtx);
+	std::vector<double>& sum = _deltas[atom][key];
+	if (sum.size() < dv.size()) sum.resize(dv.size(), 0.0);
+	for (size_t i = 0; i < dv.size(); i++)
+		sum[i] += dv[i];
+}
+
+// Grab all of the pending deltas, leaving none behind.
+std::vector<WriteBufferProxy::Delta> WriteBufferProxy::take_deltas(void)
+{
+	std::unordered_map<Handle, KeyDeltas> pend;
+	{
+		std::lock_guard<std::mutex> lck(_delta_mtx);
+		pend.swap(_deltas);
+	}
+
+	std::vector<Delta> dvec;
+	for (auto& akd : pend)
+		for (auto& kd : akd.second)
+			dvec.push_back({akd.first, kd.first, std::move(kd.second)});
+	return dvec;
+}
+
+// Writing an Atom, or a Value, sends the current Value, which already
+// includes all of the increments made so far. Any deltas still pending
+// for it must not be sent again, as they would be double-counted.
+// This is done both when the write is queued, and again just before
+// it is made, to catch deltas that arrived in between.
+void WriteBufferProxy::drop_deltas(const Handle& atom)
+{
+	std::lock_guard<std::mutex> lck(_delta_mtx);
+	if (_deltas.empty()) return;
+	_deltas.erase(atom);
+}
+
+void WriteBufferProxy::drop_deltas(const Handle& atom, const Handle& key)
+{
+	std::lock_guard<std::mutex> lck(_delta_mtx);
+	if (_deltas.empty()) return;
+	auto akd = _deltas.find(atom);
+	if (_deltas.end() == akd) return;
+	akd->second.erase(key);
+	if (akd->second.empty()) _deltas.erase(akd);
+}
+
+// Put a store at the end of the log, first removing the earlier
+// store of the same thing, if any. Caller must hold the log lock.
+void WriteBufferProxy::log_entry(const Handle& atom, const Handle& key)
+{
+	LogIndex& idx = _log_index[atom];
+	uint64_t& seq = (nullptr == key) ? idx.aseq : idx.vseq[key];
+	if (0 < seq) _log.erase(seq);
+	seq = ++_log_seq;
+	_log.emplace_hint(_log.end(), seq, LogEntry{atom, key});
+}
+
+void WriteBufferProxy::log_atoms(const HandleSeq& atoms)
+{
+	std::lock_guard<std::mutex> lck(_log_mtx);
+	for (const Handle& h : atoms)
+		log_entry(h, Handle::UNDEFINED);
+	_log_size = _log.size();
+}
+
+void WriteBufferProxy::log_values(
+	const std::vector<std::pair<Handle, Handle>>& atom_keys)
+{
+	std::lock_guard<std::mutex> lck(_log_mtx);
+	for (const std::pair<Handle, Handle>& ak : atom_keys)
+		log_entry(ak.first, ak.second);
+	_log_size = _log.size();
+}
+
+// Pull up to `nget` stores off the front of the log, oldest first.
+std::vector<WriteBufferProxy::LogEntry> WriteBufferProxy::take_log(size_t nget)
+{
+	std::vector<LogEntry> ops;
+	std::lock_guard<std::mutex> lck(_log_mtx);
+	auto it = _log.begin();
+	while (_log.end() != it and ops.size() < nget)
+	{
+		LogEntry& op = it->second;
+		auto ii = _log_index.find(op.atom);
+		if (nullptr == op.key)
+			ii->second.aseq = 0;
+		else
+			ii->second.vseq.erase(op.key);
+		if (0 == ii->second.aseq and ii->second.vseq.empty())
+			_log_index.erase(ii);
+
+		ops.emplace_back(std::move(op));
+		it = _log.erase(it);
+	}
+	_log_size = _log.size();
+	return ops;
+}
+
+void WriteBufferProxy::drop_log(const Handle& atom)
+{
+	std::lock_guard<std::mutex> lck(_log_mtx);
+	auto ii = _log_index.find(atom);
+	if (_log_index.end() == ii) return;
+	if (0 < ii->second.aseq) _log.erase(ii->second.aseq);
+	for (const auto& kseq : ii->second.vseq)
+		_log.erase(kseq.second);
+	_log_index.erase(ii);
+	_log_size = _log.size();
 }
 
 void WriteBufferProxy::barrier(AtomSpace* as)
 {
 	_nbars ++;
 
-	// Unconditionally drain both queues.
+	// Unconditionally drain both queues, and the deltas. This also
+	// waits for the drain thread to finish its batch, if any.
+	std::unique_lock<std::mutex> blck(_batch_mtx);
+	std::vector<Delta> dvec = take_deltas();
+
 	size_t bufsz = _value_queue.size();
-	std::vector<std::pair<Handle, Handle>> vav =
-		_value_queue.try_get(bufsz);
-	for (const std::pair<Handle, Handle>& kvp : vav)
-		WriteThruProxy::storeValue(kvp.first, kvp.second);
+	std::vector<std::pair<Handle, Handle>> vav = take_values(bufsz);
 
 	bufsz = _atom_queue.size();
 	HandleSeq avec = _atom_queue.try_get(bufsz);
-	for (const Handle& h : avec)
-		WriteThruProxy::storeAtom(h);
+
+	std::vector<LogEntry> ops = take_log(SIZE_MAX);
+	try
+	{
+		write_batch(dvec, avec, vav);
+		write_ordered(ops);
+	}
+	catch (...)
+	{
+		requeue(dvec, avec, vav, ops);
+		throw;
+	}
+
+	// Everything that was spilled came after what was in the queues.
+	if (_spilling) replay_spill(1.0);
+	blck.unlock();
+	wake_producers();
 
 	WriteThruProxy::barrier(as);
 }
 
+// Put a batch that could not be written back on the queues, to be
+// tried again. Part of it may have been written already. That is
+// harmless for the stores, which send the current Atom or Value, but
+// not for the deltas, which would be counted twice. So the deltas
+// are put back as stores of the whole Value.
+void WriteBufferProxy::requeue(const std::vector<Delta>& dvec,
+                    const HandleSeq& avec,
+                    const std::vector<std::pair<Handle, Handle>>& vav,
+                    const std::vector<LogEntry>& ops)
+{
+	for (const Handle& h : avec)
+		_atom_queue.insert(h);
+
+	{
+		std::lock_guard<std::mutex> lck(_vidx_mtx);
+		for (const std::pair<Handle, Handle>& kvp : vav)
+		{
+			_value_queue.insert(kvp);
+			_value_index[kvp.first].insert(kvp.second);
+		}
+		for (const Delta& d : dvec)
+		{
+			_value_queue.insert({d.atom, d.key});
+			_value_index[d.atom].insert(d.key);
+		}
+	}
+
+	if (0 == ops.size()) return;
+	std::lock_guard<std::mutex> lck(_log_mtx);
+	for (const LogEntry& op : ops)
+		log_entry(op.atom, op.key);
+	_log_size = _log.size();
+}
+
+// Write out a batch of deltas, Atoms and Values. If there is more
+// than one writer, the batch is sharded by Atom hash, so that all
+// writes for any given Atom are done by the same thread, in the same
+// order as the single-writer case. The next batch is not pulled off
+// the queues until this one is done, so nothing is reordered between
+// batches, either.
+void WriteBufferProxy::write_batch(const std::vector<Delta>& dvec,
+                    const HandleSeq& avec,
+                    const std::vector<std::pair<Handle, Handle>>& vav)
+{
+	size_t nwrites = dvec.size() + avec.size() + vav.size();
+	if (0 == nwrites) return;
+
+	using namespace std::chrono;
+	steady_clock::time_point start = steady_clock::now();
+
+	size_t nshards = _nwriters;
+	if (nshards <= 1 or nwrites < nshards)
+	{
+		write_shard(dvec, avec, vav);
+		_batch_secs.observe(duration_cast<duration<double>>(
+			steady_clock::now() - start).count());
+		return;
+	}
+
+	std::vector<std::vector<Delta>> dshard(nshards);
+	std::vector<HandleSeq> ashard(nshards);
+	std::vector<std::vector<std::pair<Handle, Handle>>> vshard(nshards);
+	for (const Delta& d : dvec)
+		dshard[d.atom->get_hash() % nshards].push_back(d);
+	for (const Handle& h : avec)
+		ashard[h->get_hash() % nshards].push_back(h);
+	for (const std::pair<Handle, Handle>& kvp : vav)
+		vshard[kvp.first->get_hash() % nshards].push_back(kvp);
+
+	// Exceptions thrown by the targets are passed back to the caller,
+	// on this thread; the writer threads must not throw.
+	std::vector<std::exception_ptr> errs(nshards);
+	auto writer = [&](size_t i)
+	{
+		try { write_shard(dshard[i], ashard[i], vshard[i]); }
+		catch (...) { errs[i] = std::current_exception(); }
+	};
+
+	// Thread startup is cheap, compared to the batch size.
+	std::vector<std::thread> writers;
+	for (size_t i = 1; i < nshards; i++)
+		writers.emplace_back(writer, i);
+	writer(0);
+	for (std::thread& t : writers) t.join();
+
+	for (const std::exception_ptr& ep : errs)
+		if (ep) std::rethrow_exception(ep);
+
+	_batch_secs.observe(duration_cast<duration<double>>(
+		steady_clock::now() - start).count());
+}
+
+// The deltas go first. The Atoms and Values written after them send
+// the current Value, which includes these deltas, so a target that
+// applies deltas ends up in the same place as one that doesn't.
+void WriteBufferProxy::write_shard(const std::vector<Delta>& dvec,
+                    const HandleSeq& avec,
+                    const std::vector<std::pair<Handle, Handle>>& vav)
+{
+	for (const Delta& d : dvec)
+		WriteThruProxy::updateValue(d.atom, d.key, createFloatValue(d.sum));
+
+	// The Atoms and Values go out as whole batches, so that the
+	// targets can write them in one go.
+	for (const Handle& h : avec)
+		drop_deltas(h);
+	if (0 < avec.size())
+		WriteThruProxy::storeAtoms(avec);
+
+	for (const std::pair<Handle, Handle>& kvp : vav)
+		drop_deltas(kvp.first, kvp.second);
+	if (0 < vav.size())
+		WriteThruProxy::storeValues(vav);
+}
+
+// Write out part of the log. Runs of Atoms, and runs of Values, are
+// each sent as one batch, in order. There's no sharding; that would
+// mix up the order.
+void WriteBufferProxy::write_ordered(const std::vector<LogEntry>& ops)
+{
+	if (0 == ops.size()) return;
+
+	using namespace std::chrono;
+	steady_clock::time_point start = steady_clock::now();
+
+	size_t i = 0;
+	while (i < ops.size())
+	{
+		if (nullptr == ops[i].key)
+		{
+			HandleSeq avec;
+			while (i < ops.size() and nullptr == ops[i].key)
+				avec.push_back(ops[i++].atom);
+			WriteThruProxy::storeAtoms(avec);
+			continue;
+		}
+
+		std::vector<std::pair<Handle, Handle>> vav;
+		while (i < ops.size() and nullptr != ops[i].key)
+		{
+			vav.push_back({ops[i].atom, ops[i].key});
+			i++;
+		}
+		WriteThruProxy::storeValues(vav);
+	}
+
+	_batch_secs.observe(duration_cast<duration<double>>(
+		steady_clock::now() - start).count());
+}
+
+// ==============================================================
+// The spill file is a sequence of records, each a header line with
+// the record kind and length, followed by the record itself. The
+// length is needed, because Atom names may contain newlines. Atoms
+// are written with `Sexpr::dump_atom()`, so that all of their Values
+// go along with them; Values are written as the key, followed by the
+// Atom with just that one Value on it.
+
+// Read one record. Returns false at end-of-file, or if the record
+// was cut short. The header is read as a whole line, so that nothing
+// in the record itself is skipped over. The caller checks ferror().
+static bool read_record(FILE* fh, char& kind, std::string& rec)
+{
+	char hdr[32];
+	if (nullptr == fgets(hdr, sizeof(hdr), fh)) return false;
+
+	kind = hdr[0];
+	if (('a' != kind and 'v' != kind) or ' ' != hdr[1]) return false;
+
+	char* end;
+	size_t len = strtoul(&hdr[2], &end, 10);
+	if (&hdr[2] == end or '\n' != *end) return false;
+
+	rec.resize(len);
+	if (len != fread(&rec[0], 1, len, fh)) return false;
+	return '\n' == fgetc(fh);
+}
+
+void WriteBufferProxy::spill_error(const char* what)
+{
+	throw IOException(TRACE_INFO,
+		"Unable to %s spill file %s: %s",
+		what, _spill_name.c_str(), strerror(errno));
+}
+
+// Open the spill file, if one was configured. Anything already in it
+// was left behind by a crash. A torn record at the end is chopped off,
+// and the rest is queued up for replay.
+void WriteBufferProxy::open_spill(void)
+{
+	if (_spill_name.empty()) return;
+
+	_spill_fh = fopen(_spill_name.c_str(), "a+");
+	if (nullptr == _spill_fh)
+		spill_error("open");
+
+	long good = 0;
+	char kind;
+	std::string rec;
+	rewind(_spill_fh);
+	while (read_record(_spill_fh, kind, rec))
+		good = ftell(_spill_fh);
+	if (ferror(_spill_fh))
+		spill_error("read");
+
+	if (fseek(_spill_fh, 0, SEEK_END))
+		spill_error("seek");
+	if (good < ftell(_spill_fh))
+	{
+		logger().warn("WriteBufferProxy: Discarding torn record in %s",
+			_spill_name.c_str());
+		if (ftruncate(fileno(_spill_fh), good) or fsync(fileno(_spill_fh)))
+			spill_error("truncate");
+	}
+
+	_spill_read = 0;
+	_spill_restore = good;
+	_spilling = (0 < good);
+}
+
+// Called after the final barrier; the file is empty by now.
+void WriteBufferProxy::close_spill(void)
+{
+	if (nullptr == _spill_fh) return;
+	fclose(_spill_fh);
+	_spill_fh = nullptr;
+	_spilling = false;
+	unlink(_spill_name.c_str());
+}
+
+// Spill if there's a spill file, and either the queues are full, or
+// something is already spilled, and so must be written first.
+bool WriteBufferProxy::must_spill(void)
+{
+	if (nullptr == _spill_fh) return false;
+	return _spilling or overfull();
+}
+
+// Append to the spill file, and make sure it's on disk before the
+// writer is let go; the file is only useful if it survives a crash.
+// The caller must hold the spill lock. The file is opened "a+", and
+// is read from as well, so seek to the end before each write. If the
+// write fails, whatever part of it did get written is chopped off,
+// so that the file stays readable.
+void WriteBufferProxy::append_spill(const std::string& buf)
+{
+	if (fseek(_spill_fh, 0, SEEK_END))
+		spill_error("seek");
+
+	long end = ftell(_spill_fh);
+	if (buf.size() == fwrite(buf.data(), 1, buf.size(), _spill_fh) and
+	    0 == fflush(_spill_fh) and
+	    0 == fsync(fileno(_spill_fh)))
+		return;
+
+	int err = errno;
+	clearerr(_spill_fh);
+	if (0 <= end and ftruncate(fileno(_spill_fh), end))
+		logger().warn("WriteBufferProxy: Unable to trim spill file %s: %s",
+			_spill_name.c_str(), strerror(errno));
+	errno = err;
+	spill_error("write");
+}
+
+void WriteBufferProxy::spill_atoms(const HandleSeq& atoms)
+{
+	std::string buf;
+	for (const Handle& h : atoms)
+	{
+		std::string rec = Sexpr::dump_atom(h);
+		buf += "a " + std::to_string(rec.size()) + "\n" + rec + "\n";
+	}
+
+	std::lock_guard<std::mutex> lck(_spill_mtx);
+	append_spill(buf);
+	_nspills += atoms.size();
+	_spilling = true;
+}
+
+void WriteBufferProxy::spill_values(
+	const std::vector<std::pair<Handle, Handle>>& atom_keys)
+{
+	std::string buf;
+	for (const std::pair<Handle, Handle>& ak : atom_keys)
+	{
+		// Values that were removed are written without the alist.
+		std::string rec = Sexpr::encode_atom(ak.second) + " ";
+		if (ak.first->getValue(ak.second))
+			rec += Sexpr::dump_vatom(ak.first, ak.second);
+		else
+			rec += Sexpr::encode_atom(ak.first);
+		buf += "v " + std::to_string(rec.size()) + "\n" + rec + "\n";
+	}
+
+	std::lock_guard<std::mutex> lck(_spill_mtx);
+	append_spill(buf);
+	_nspills += atom_keys.size();
+	_spilling = true;
+}
+
+// Write out the given fraction of the spill file (at least a megabyte
+// of it), in order, straight to the targets. The caller must hold the
+// batch lock. Live Atoms are written with their current Values; Atoms
+// that were removed in the meantime are skipped. Records from before
+// a crash are put back into the AtomSpace, Values and all, first.
+// When all of it has been written, the file is emptied, and writes
+// go back to the queues. Returns true if that happened.
+bool WriteBufferProxy::replay_spill(double frac)
+{
+#define SPILL_CHUNK (1024*1024)
+	std::vector<std::pair<char, std::string>> recs;
+	std::vector<long> offsets;
+	long done;
+	{
+		std::lock_guard<std::mutex> lck(_spill_mtx);
+		if (fseek(_spill_fh, 0, SEEK_END))
+			spill_error("seek");
+		long left = ftell(_spill_fh) - _spill_read;
+		long nbytes = ceil(frac * left);
+		if (nbytes < SPILL_CHUNK) nbytes = SPILL_CHUNK;
+
+		if (fseek(_spill_fh, _spill_read, SEEK_SET))
+			spill_error("seek");
+		done = _spill_read;
+		char kind;
+		std::string rec;
+		while (done - _spill_read < nbytes and
+		       read_record(_spill_fh, kind, rec))
+		{
+			offsets.push_back(done);
+			recs.push_back({kind, std::move(rec)});
+			done = ftell(_spill_fh);
+		}
+		if (ferror(_spill_fh))
+			spill_error("read");
+	}
+
+	AtomSpace* as = _target_as;
+	if (nullptr == as) as = getAtomSpace();
+
+	std::vector<LogEntry> ops;
+	for (size_t i = 0; i < recs.size(); i++)
+	{
+		const std::string& rec = recs[i].second;
+		size_t pos = 0;
+		Handle key;
+		if ('v' == recs[i].first)
+			key = Sexpr::decode_atom(rec, pos);
+		Handle h = Sexpr::decode_atom(rec, pos);
+
+		bool restore = offsets[i] < _spill_restore;
+		Handle live = as->get_atom(h);
+		if (nullptr == live)
+		{
+			if (not restore) continue;
+			live = as->add_atom(h);
+		}
+		if (restore)
+		{
+			for (const Handle& k : h->getKeys())
+				as->set_value(live, as->add_atom(k),
+					Sexpr::add_atoms(as, h->getValue(k)));
+		}
+
+		if ('a' == recs[i].first)
+			ops.push_back({live, Handle::UNDEFINED});
+		else
+			ops.push_back({live, as->add_atom(key)});
+	}
+
+	if (_ordered)
+		write_ordered(ops);
+	else
+	{
+		HandleSeq avec;
+		std::vector<std::pair<Handle, Handle>> vav;
+		for (const LogEntry& op : ops)
+		{
+			if (nullptr == op.key)
+				avec.push_back(op.atom);
+			else
+				vav.push_back({op.atom, op.key});
+		}
+		write_batch({}, avec, vav);
+	}
+
+	// Nothing else reads the file, but producers may have appended
+	// more to it, while the batch was being written.
+	std::lock_guard<std::mutex> lck(_spill_mtx);
+	_spill_read = done;
+	if (fseek(_spill_fh, 0, SEEK_END))
+		spill_error("seek");
+	if (_spill_read < ftell(_spill_fh)) return false;
+
+	if (ftruncate(fileno(_spill_fh), 0) or fsync(fileno(_spill_fh)))
+		spill_error("truncate");
+	_spill_read = 0;
+	_spill_restore = 0;
+	_spilling = false;
+	return true;
+}
+
 // ==============================================================
 
 void WriteBufferProxy::reset_stats(void)
@@ -232,6 +1056,7 @@ void WriteBufferProxy::reset_stats(void)
 	_novertime = 0;
 	_nbars = 0;
 	_ndumps = 0;
+	_nspills = 0;
 	_astore = 0;
 	_vstore = 0;
 	_mavg_in_atoms = 0.0;
@@ -241,6 +1066,8 @@ void WriteBufferProxy::reset_stats(void)
 	_mavg_out_atoms = 0.0;
 	_mavg_out_values = 0.0;
 	_mavg_load = 0.0;
+	_batch_secs.reset();
+	_queue_depth.reset();
 }
 
 std::string WriteBufferProxy::monitor(void)
@@ -253,6 +1080,7 @@ std::string WriteBufferProxy::monitor(void)
 	rpt += "   barriers: " + std::to_string(_nbars);
 	rpt += "   stalls: " + std::to_string(_nstalls);
 	rpt += "   overtime: " + std::to_string(_novertime);
+	rpt += "   spilled: " + std::to_string(_nspills);
 	rpt += "\n";
 
 	// std::to_string prints six decimal places but we want zero.
@@ -270,41 +1098,196 @@ std::string WriteBufferProxy::monitor(void)
 	// Duty cycle is the amount of time that the write thread
 	// is actually writing, vs. the elapsed wallclock time.
 	// Anything over 100 will lead to buffer overflows.
+	rpt += "Est. bytes queued: " + std::to_string(queued_bytes());
+	size_t budget = _mem_budget;
+	rpt += "   budget: " + (0 < budget ?
+		std::to_string(budget) : std::string("none"));
+	rpt += "\n";
+
 	rpt += "Timescale (secs): " + PFLO(_decay);
 	rpt += "   Ticker (secs): " + PFLO(_ticker);
 	rpt += "   Duty cycle (load avg): " + std::to_string(_mavg_load);
 	rpt += "\n";
 
+	rpt += "High-water mark: " + std::to_string(_high_water_mark);
+	rpt += "   Est. secs/write: " + std::to_string(_write_secs);
+	rpt += "   Mark cuts: " + std::to_string(_mark_cuts);
+	rpt += "\n";
+
 	return rpt;
 }
 
 // ==============================================================
+// Structured metrics, for scraping by Prometheus and the like.
+
+WriteBufferProxy::Histogram::Histogram(std::vector<double>&& b) :
+	bounds(std::move(b)),
+	counts(new std::atomic<size_t>[bounds.size() + 1])
+{
+	reset();
+}
+
+void WriteBufferProxy::Histogram::observe(double x)
+{
+	size_t i = 0;
+	while (i < bounds.size() and bounds[i] < x) i++;
+	counts[i] ++;
+
+	// There's no atomic add for doubles, before C++20.
+	double old = sum;
+	while (not sum.compare_exchange_weak(old, old + x)) {}
+}
+
+void WriteBufferProxy::Histogram::reset(void)
+{
+	for (size_t i = 0; i <= bounds.size(); i++) counts[i] = 0;
+	sum = 0.0;
+}
+
+static std::string fmt(double x)
+{
+	char buf[40];
+	snprintf(buf, sizeof(buf), "%.15g", x);
+	return buf;
+}
+
+#define MPFX "atomspace_write_buffer_"
+
+void WriteBufferProxy::add_histogram(std::vector<Metric>& mets,
+                                     const char* name, const Histogram& hist)
+{
+	size_t cumu = 0;
+	for (size_t i = 0; i < hist.bounds.size(); i++)
+	{
+		cumu += hist.counts[i];
+		mets.push_back({name, "histogram", "_bucket",
+			fmt(hist.bounds[i]), (double) cumu});
+	}
+	cumu += hist.counts[hist.bounds.size()];
+	mets.push_back({name, "histogram", "_bucket", "+Inf", (double) cumu});
+	mets.push_back({name, "histogram", "_sum", "", hist.sum});
+	mets.push_back({name, "histogram", "_count", "", (double) cumu});
+}
+
+/// Return a snapshot of all of the metrics. Each is read atomically,
+/// but not all together. The histogram count is the sum of the
+/// buckets, so that the two always agree.
+std::vector<WriteBufferProxy::Metric> WriteBufferProxy::metrics(void)
+{
+	std::vector<Metric> mets;
+	auto counter = [&](const char* name, double val)
+		{ mets.push_back({name, "counter", "", "", val}); };
+	auto gauge = [&](const char* name, double val)
+		{ mets.push_back({name, "gauge", "", "", val}); };
+
+	counter(MPFX "atoms_stored_total", _atoms_in);
+	counter(MPFX "values_stored_total", _values_in);
+	counter(MPFX "writes_total", _ndumps);
+	counter(MPFX "barriers_total", _nbars);
+	counter(MPFX "stalls_total", _nstalls);
+	counter(MPFX "overtime_total", _novertime);
+	counter(MPFX "mark_cuts_total", _mark_cuts);
+	counter(MPFX "spilled_total", _nspills);
+
+	gauge(MPFX "atoms_queued", _atom_queue.size());
+	gauge(MPFX "values_queued", _value_queue.size());
+	gauge(MPFX "log_queued", _log_size);
+	gauge(MPFX "bytes_queued", queued_bytes());
+	gauge(MPFX "memory_budget_bytes", _mem_budget);
+	gauge(MPFX "high_water_mark", _high_water_mark);
+	gauge(MPFX "write_seconds", _write_secs);
+	gauge(MPFX "duty_cycle", _mavg_load);
+	gauge(MPFX "spilling", _spilling ? 1.0 : 0.0);
+
+	add_histogram(mets, MPFX "batch_seconds", _batch_secs);
+	add_histogram(mets, MPFX "queue_depth", _queue_depth);
+	return mets;
+}
+
+/// The metrics as a LinkValue holding two Values: a StringValue of
+/// names, and a FloatValue of the matching numbers. The names are
+/// the Prometheus series names, e.g. `..._batch_seconds_bucket{le="0.1"}`.
+ValuePtr WriteBufferProxy::metrics_value(void)
+{
+	std::vector<std::string> names;
+	std::vector<double> vals;
+	for (const Metric& m : metrics())
+	{
+		std::string name = m.name + m.suffix;
+		if (0 < m.le.size()) name += "{le=\"" + m.le + "\"}";
+		names.emplace_back(std::move(name));
+		vals.push_back(m.value);
+	}
+	return createLinkValue(ValueSeq({
+		createStringValue(std::move(names)),
+		createFloatValue(std::move(vals))}));
+}
+
+/// The metrics in the Prometheus text exposition format. Every series
+/// is labelled with the name of this proxy, so that several buffers
+/// can be scraped from the same process.
+std::string WriteBufferProxy::prometheus(void)
+{
+	std::string label = "proxy=\"";
+	for (char c : get_name())
+	{
+		if ('\\' == c or '"' == c) label += '\\';
+		if ('\n' == c) { label += "\\n"; continue; }
+		label += c;
+	}
+	label += "\"";
+
+	std::string txt;
+	std::string family;
+	for (const Metric& m : metrics())
+	{
+		if (m.name != family)
+		{
+			family = m.name;
+			txt += "# TYPE " + m.name + " " + m.type + "\n";
+		}
+		txt += m.name + m.suffix + "{" + label;
+		if (0 < m.le.size()) txt += ",le=\"" + m.le + "\"";
+		txt += "} " + fmt(m.value) + "\n";
+	}
+	return txt;
+}
+
+// ==============================================================
+
+// Moving average of the last ten writes.
+#define WEI 0.1
 
 // This runs in it's own thread, and drains a fraction of the queue.
-// Currently, only one thread is used for draining the queue. The
-// assumption is that additional threads will not help, because of
-// lock contention in the target. But I don't know for sure. Indirect
-// evidence from RocksStorage indicates that bombarding it from multiple
-// threads does not improve throughput. So, for now, just one thread.
+// By default, only one thread writes to the targets. The assumption
+// is that additional threads will not help, because of lock contention
+// in the target. Indirect evidence from RocksStorage indicates that
+// bombarding it from multiple threads does not improve throughput.
+// Other targets (remote or file-backed) do scale, so the number of
+// writers can be set with the `*-drain-threads-*` message; see
+// `write_batch()` for how the work is split.
 void WriteBufferProxy::drain_loop(void)
 {
-	// Keep a moving average queue size. This is used to determine
-	// when the queue is almost empty, by historical standards, which
-	// is then used to flsuh out the remainer of the queue.
-	reset_stats();
+	// The stats were reset by open(), before this thread was started.
+	// The moving averages are for the monitor only; the flow control
+	// is done by the RateController.
 
 	using namespace std::chrono;
 
-	// Cycle time. Write-outs happen at least every ten seconds.
-	_ticker = 0.25 * _decay;
-	if (10.0 < _ticker) _ticker = 10.0;
-
-	// Amount to write per cycle, scaled by exponential time constant.
+	// The latency target sets the cycle time, and the drain rate.
+	// It can be changed while open; it is picked up again below.
+	_rate.set_slo(_decay);
+	_ticker = _rate.tick();
 	double frac = _ticker / _decay;
 
 	// First time through: after opening, sleep for a little while.
+	// Wake up early if someone is stalled, or if we're closed.
+	auto woken = [this] { return _stop or 0 < _nwaiting; };
 	uint nappy = 1 + ceil(1000.0 * _ticker);
-	std::this_thread::sleep_for(milliseconds(nappy));
+	{
+		std::unique_lock<std::mutex> lck(_mtx);
+		_drain_cv.wait_for(lck, milliseconds(nappy), woken);
+	}
 
 	// Start with non-zero moving avg, approximating what it should be.
 	_mavg_in_atoms = _astore;
@@ -319,132 +1302,117 @@ void WriteBufferProxy::drain_loop(void)
 	{
 		steady_clock::time_point awake = steady_clock::now();
 
-		bool wrote = false;
-
-		// Exec block unconditionally. Need to do this to have
-		// the moving avg's update correctly.
-		if (true)
-		{
-			// How many Atoms waiting to be written?
-			double qsz = (double) _atom_queue.size();
-
-			// How many should we write?
-			uint nwrite = ceil(frac * qsz);
-
-			// Moving average of the last ten writes.
-#define WEI 0.1
-			_mavg_buf_atoms = (1.0-WEI) * _mavg_buf_atoms + WEI * qsz;
-
-			// Whats the min to write? The goal here is to not
-			// dribble out the tail, but to push it out, if its
-			// almost all gone anyway.
-			uint mwr = ceil(0.5 * frac * _mavg_buf_atoms);
-			if (mwr < 1000) mwr = 1000;
-			if (nwrite < mwr) nwrite = mwr;
-
-			// Store that many.
-			HandleSeq avec = _atom_queue.try_get(nwrite, 0 == nwrite%7);
-			for (const Handle& h : avec)
-				WriteThruProxy::storeAtom(h);
-
-			// Collect performance stats.
-			_mavg_in_atoms = (1.0-WEI) * _mavg_in_atoms + WEI * _astore;
-			_astore = 0;
-			_mavg_out_atoms = (1.0-WEI) * _mavg_out_atoms + WEI * avec.size();
-
-			if (0 < avec.size()) wrote = true;
-		}
+		double decay = _decay;
+		_rate.set_slo(decay);
+		_ticker = _rate.tick();
+		frac = _ticker / decay;
 
-		// Cut-n-paste of above.
-		if (true)
-		{
-			// How many values are waiting to be written?
-			double qsz = (double) _value_queue.size();
-
-			// How many should we write?
-			uint nwrite = ceil(frac * qsz);
+		bool wrote = false;
+		_queue_depth.observe(
+			_atom_queue.size() + _value_queue.size() + _log_size);
+		std::unique_lock<std::mutex> blck(_batch_mtx);
+		std::vector<Delta> dvec = take_deltas();
+		HandleSeq avec;
+		std::vector<std::pair<Handle, Handle>> vav;
+		std::vector<LogEntry> ops;
+
+		// Atoms. In ordered mode, the log holds both the Atoms and
+		// the Values.
+		size_t aqsz = _ordered ? _log_size.load() : _atom_queue.size();
+		_mavg_buf_atoms = (1.0-WEI) * _mavg_buf_atoms + WEI * aqsz;
+
+		size_t nwrite = _rate.batch_size(aqsz);
+		if (_ordered)
+			ops = take_log(nwrite);
+		else
+			avec = _atom_queue.try_get(nwrite, 0 == nwrite%7);
 
-			// Moving avg.
-			_mavg_buf_values = (1.0-WEI) * _mavg_buf_values + WEI * qsz;
+		// Collect performance stats.
+		_mavg_in_atoms = (1.0-WEI) * _mavg_in_atoms + WEI * _astore;
+		_astore = 0;
+		_mavg_out_atoms = (1.0-WEI) * _mavg_out_atoms +
+			WEI * (avec.size() + ops.size());
 
-			// Min to write.
-			uint mwr = ceil(0.5 * frac * _mavg_buf_values);
-			if (mwr < 1000) mwr = 1000;
-			if (nwrite < mwr) nwrite = mwr;
+		// Values.
+		size_t vqsz = _value_queue.size();
+		_mavg_buf_values = (1.0-WEI) * _mavg_buf_values + WEI * vqsz;
 
-			// Store that many
-			std::vector<std::pair<Handle, Handle>> vav =
-				_value_queue.try_get(nwrite, 0 == nwrite%7);
-			for (const std::pair<Handle, Handle>& kvp : vav)
-				WriteThruProxy::storeValue(kvp.first, kvp.second);
+		nwrite = _rate.batch_size(vqsz);
+		vav = take_values(nwrite, 0 == nwrite%7);
 
-			// Collect performance stats
-			_mavg_in_values = (1.0-WEI) * _mavg_in_values + WEI * _vstore;
-			_vstore = 0;
-			_mavg_out_values = (1.0-WEI) * _mavg_out_values + WEI * vav.size();
+		_mavg_in_values = (1.0-WEI) * _mavg_in_values + WEI * _vstore;
+		_vstore = 0;
+		_mavg_out_values = (1.0-WEI) * _mavg_out_values + WEI * vav.size();
 
-			if (0 < vav.size()) wrote = true;
+		// There is no one to pass target errors back to. The batch
+		// is put back on the queues, and tried again next time.
+		size_t nout = dvec.size() + avec.size() + vav.size() + ops.size();
+		try
+		{
+			write_batch(dvec, avec, vav);
+			write_ordered(ops);
+		}
+		catch (const std::exception& ex)
+		{
+			logger().warn("WriteBufferProxy: Write failed, will retry: %s",
+				ex.what());
+			requeue(dvec, avec, vav, ops);
+			nout = 0;
 		}
 
+		// Tell the controller how long that took, and how much is
+		// still waiting; it sets the high-water mark.
+		double wrtime = duration_cast<duration<double>>(
+			steady_clock::now() - awake).count();
+		_rate.update(_atom_queue.size() + _value_queue.size() + _log_size,
+			nout, wrtime);
+		_high_water_mark = _rate.high_water_mark();
+		_write_secs = _rate.cost();
+		_mark_cuts = _rate.cuts();
+		if (0 < nout) wrote = true;
+
+		// The spill file holds writes made after the queues filled
+		// up. Replay some of it, once the queues are empty, i.e.
+		// once the targets have caught up.
+		if (_spilling and 0 == _atom_queue.size() and
+		    0 == _value_queue.size() and 0 == _log_size)
+		{
+			// Records are marked as replayed only after they are
+			// written; on failure, they are replayed again later.
+			try { replay_spill(frac); }
+			catch (const std::exception& ex)
+			{
+				logger().warn("WriteBufferProxy: Replay failed, will retry: %s",
+					ex.what());
+			}
+			wrote = true;
+		}
+		blck.unlock();
 		if (wrote) _ndumps ++;
 
 		// How much time did it take to write everything?
-		steady_clock::time_point wrdone = steady_clock::now();
-		double wrtime = duration_cast<duration<double>>(wrdone-awake).count();
+		wrtime = duration_cast<duration<double>>(
+			steady_clock::now() - awake).count();
 
 		// Moving averge duty factor.
 		_mavg_load = (1.0-WEI) * _mavg_load + WEI * wrtime / _ticker;
 
+		// The mark may have gone up, or the queues down.
+		wake_producers();
+
 		// How much time do we have left to sleep?
 		double left = _ticker - wrtime;
-		if (0.0 < left)
-		{
-			// I guess we're good. Relax the high-water mark a bit.
-			if (_high_water_mark < HIMAX)
-			{
-				_high_water_mark *= 17;
-				_high_water_mark /= 16;
-			}
-			uint naptime = floor(1000.0 * left);
-			std::this_thread::sleep_for(milliseconds(naptime));
-		}
-		else
+		if (left <= 0.0)
 		{
-			// Oh no! Cannot keep up with the requested time limit!
-			// Pause readers until the queue drains down a bit.
-			// _mavg_out is how many we are able to actually write,
-			// per `rwtime` interval. Scaling sets a buffer size that
-			// should be able to clear at exactly that rate. So this
-			// should be able to hold the duty cycle to #define DUTY
-			// as the mean value. By setting DUTY_CYCLE to greater
-			// than one, this should keep the write rate saturated
-			// at max possible, so that we are *always* stalling.
-			// And that's OK, because the _high_water_mark will
-			// rate limit the inflow. Then the average buffer size
-			// will then be ("exactly") equal to _high_water_mark.
-			// The only thing that a larger _decay does is to
-			// increase the high-water mark. Other than that, the
-			// system runs maxed out.  An alternative API would
-			// allow the user to set the watermark directly, and
-			// then we'd reverse all these calculations to get a
-			// `_decay` value that's suitable. This just gives the
-			// same behavior in the end, just a different API.
-
-			// Averge amount of time taken to write `frac` of buffer.
-			double avg_write_time = _ticker * _mavg_load;
-
-			// Moving averge of fraction actually written
-			// Should be more-or-less equal to `frac`, defined at top.
-			double actual_frac = avg_write_time / _decay;
-
-			// We want to clamp down on the larger of the two.
-			double worst = fmax(_mavg_out_atoms, _mavg_out_values);
-
-#define DUTY_CYCLE 1.2
-			// Based on clearing rate, the number we can manage in cache.
-			_high_water_mark = DUTY_CYCLE * worst / actual_frac;
+			// Cannot keep up! The controller has already clamped
+			// down on the high-water mark; go right back to work.
 			_novertime ++;
+			continue;
 		}
+
+		uint naptime = floor(1000.0 * left);
+		std::unique_lock<std::mutex> lck(_mtx);
+		_drain_cv.wait_for(lck, milliseconds(naptime), woken);
 	}
 }
 
@@ -23,8 +23,16 @@
 #ifndef _OPENCOG_WRITE_BUFFER_PROXY_H
 #define _OPENCOG_WRITE_BUFFER_PROXY_H
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <unordered_map>
 #include <opencog/util/concurrent_set.h>
+#include <opencog/persist/proxy/RateController.h>
 #include <opencog/persist/proxy/WriteThruProxy.h>
 
 namespace opencog
@@ -35,31 +43,181 @@ namespace opencog
 class WriteBufferProxy : public WriteThruProxy
 {
 private:
-	// Performance-monitoring stats
+	// Performance-monitoring stats. These are updated by the drain
+	// thread and by the producers, and read by monitor() and metrics(),
+	// all at the same time; thus atomic.
 	void reset_stats(void);
-	size_t _nstalls;
-	size_t _novertime;
-	size_t _nbars;
-	size_t _ndumps;
-	size_t _astore;
-	size_t _vstore;
-	double _mavg_in_atoms;
-	double _mavg_in_values;
-	double _mavg_buf_atoms;
-	double _mavg_buf_values;
-	double _mavg_out_atoms;
-	double _mavg_out_values;
-	double _mavg_load;
+	std::atomic<size_t> _nstalls;
+	std::atomic<size_t> _novertime;
+	std::atomic<size_t> _nbars;
+	std::atomic<size_t> _ndumps;
+	std::atomic<size_t> _nspills;
+	std::atomic<size_t> _astore;
+	std::atomic<size_t> _vstore;
+	std::atomic<double> _mavg_in_atoms;
+	std::atomic<double> _mavg_in_values;
+	std::atomic<double> _mavg_buf_atoms;
+	std::atomic<double> _mavg_buf_values;
+	std::atomic<double> _mavg_out_atoms;
+	std::atomic<double> _mavg_out_values;
+	std::atomic<double> _mavg_load;
+
+	// Fixed-bucket histogram. Bucket `i` counts the observations
+	// no larger than `bounds[i]`; the last bucket is everything else.
+	// The buckets are made cumulative when exported.
+	struct Histogram
+	{
+		Histogram(std::vector<double>&&);
+		void observe(double);
+		void reset(void);
+		const std::vector<double> bounds;
+		std::unique_ptr<std::atomic<size_t>[]> counts;
+		std::atomic<double> sum;
+	};
+	Histogram _batch_secs;
+	Histogram _queue_depth;
+
+	// One exported number. Histograms become several of these:
+	// the buckets, the sum and the count.
+	struct Metric
+	{
+		std::string name;
+		const char* type;    // "counter", "gauge" or "histogram"
+		std::string suffix;  // "_bucket", "_sum" or "_count"
+		std::string le;      // Upper bound, for "_bucket"
+		double value;
+	};
+	std::vector<Metric> metrics(void);
+	void add_histogram(std::vector<Metric>&, const char*, const Histogram&);
+	ValuePtr metrics_value(void);
+	std::string prometheus(void);
 
 protected:
-	double _decay;
-	double _ticker;
-	size_t _high_water_mark;
+	// The decay time is the latency target: queued writes should not
+	// wait much longer than this. The controller uses it, and the
+	// measured write times, to set the drain rate and the high-water
+	// mark.
+	std::atomic<double> _decay;
+	std::atomic<double> _ticker;
+	RateController _rate;
+
+	// Copies of the controller state, made by the drain thread after
+	// each update, for the monitor and metrics to read.
+	std::atomic<size_t> _high_water_mark;
+	std::atomic<double> _write_secs;
+	std::atomic<size_t> _mark_cuts;
+	std::atomic<size_t> _nwriters;
+
+	// Memory budget, in bytes; zero means no budget. The bytes held
+	// are estimated from the queue lengths, and the average sizes of
+	// the Atoms and Values that went into the queues.
+	std::atomic<size_t> _mem_budget;
+	std::atomic<size_t> _atom_bytes_in;
+	std::atomic<size_t> _atoms_in;
+	std::atomic<size_t> _value_bytes_in;
+	std::atomic<size_t> _values_in;
+	size_t queued_bytes(void);
 	concurrent_set<Handle> _atom_queue;
 	concurrent_set<std::pair<Handle,Handle>> _value_queue;
 	std::thread _drain_thread;
-	bool _stop;
+	std::atomic<bool> _stop;
 	void drain_loop();
+
+	// Held while a batch is pulled off the queues and written, so
+	// that barrier() can wait for the drain thread's batch to land.
+	std::mutex _batch_mtx;
+
+	// Backpressure. Producers that find the queues over the high-water
+	// mark wait on `_room_cv`; the drain thread waits on `_drain_cv`
+	// in between write-outs, and is woken early if producers are
+	// waiting, or on close.
+	std::mutex _mtx;
+	std::condition_variable _room_cv;
+	std::condition_variable _drain_cv;
+	size_t _nwaiting;
+	bool overfull(void);
+	void stall(void);
+	void wake_producers(void);
+
+	// FloatValue deltas from `updateValue()`, summed per (atom, key)
+	// while they wait, and sent on as one delta per key.
+	struct Delta
+	{
+		Handle atom;
+		Handle key;
+		std::vector<double> sum;
+	};
+	typedef std::unordered_map<Handle, std::vector<double>> KeyDeltas;
+	std::mutex _delta_mtx;
+	std::unordered_map<Handle, KeyDeltas> _deltas;
+	std::vector<Delta> take_deltas(void);
+	void drop_deltas(const Handle&);
+	void drop_deltas(const Handle&, const Handle&);
+
+	// The keys of the pending Values, per Atom, so that removeAtom()
+	// can find them without scanning or flushing the whole queue. The
+	// lock is held across both the queue and the index.
+	std::mutex _vidx_mtx;
+	std::unordered_map<Handle, HandleSet> _value_index;
+	std::vector<std::pair<Handle,Handle>> take_values(size_t, bool = false);
+	void drop_values(const Handle&);
+
+	// Ordered mode. Instead of the two queues, there is one log of
+	// Atom and Value stores, kept in the order they were made, and
+	// written out in that order, by one thread. Storing an Atom, or
+	// a Value, that is already in the log moves it to the end, so
+	// that only the latest store is written. The key is null for an
+	// Atom store. Deltas are logged as plain Value stores.
+	struct LogEntry
+	{
+		Handle atom;
+		Handle key;
+	};
+	struct LogIndex
+	{
+		uint64_t aseq = 0;
+		std::unordered_map<Handle, uint64_t> vseq;
+	};
+	bool _ordered;
+	std::mutex _log_mtx;
+	uint64_t _log_seq;
+	std::map<uint64_t, LogEntry> _log;
+	std::unordered_map<Handle, LogIndex> _log_index;
+	std::atomic<size_t> _log_size;
+	void log_entry(const Handle&, const Handle&);
+	void log_atoms(const HandleSeq&);
+	void log_values(const std::vector<std::pair<Handle,Handle>>&);
+	std::vector<LogEntry> take_log(size_t);
+	void drop_log(const Handle&);
+	void write_ordered(const std::vector<LogEntry>&);
+
+	// Optional overflow file. When the queues are full, writes are
+	// appended to this file, instead of stalling the producer. Once
+	// anything has been spilled, all writes go to the file, until the
+	// drain thread has replayed it, so that the order is kept. A file
+	// left behind by a crash is replayed on the next open().
+	std::string _spill_name;
+	FILE* _spill_fh;
+	std::mutex _spill_mtx;
+	std::atomic<bool> _spilling;
+	long _spill_read;       // Offset of the next record to replay.
+	long _spill_restore;    // Records before this are from a crash.
+	void open_spill(void);
+	void close_spill(void);
+	bool must_spill(void);
+	void spill_error(const char*);
+	void append_spill(const std::string&);
+	void spill_atoms(const HandleSeq&);
+	void spill_values(const std::vector<std::pair<Handle,Handle>>&);
+	bool replay_spill(double);
+
+	void write_batch(const std::vector<Delta>&, const HandleSeq&,
+	                 const std::vector<std::pair<Handle,Handle>>&);
+	void write_shard(const std::vector<Delta>&, const HandleSeq&,
+	                 const std::vector<std::pair<Handle,Handle>>&);
+	void requeue(const std::vector<Delta>&, const HandleSeq&,
+	             const std::vector<std::pair<Handle,Handle>>&,
+	             const std::vector<LogEntry>&);
 	void erase_recursive(const Handle&);
 
 private:
@@ -71,6 +229,7 @@ public:
 	virtual ~WriteBufferProxy();
 
 	virtual void setValue(const Handle& key, const ValuePtr& value);
+	virtual ValuePtr getValue(const Handle& key) const;
 
 	// ----------------------------------------------------------------
 	virtual void open(void);
@@ -83,6 +242,8 @@ protected:
 	virtual void storeAtom(const Handle&, bool synchronous = false);
 	virtual void removeAtom(AtomSpace*, const Handle&, bool recursive);
 	virtual void storeValue(const Handle& atom, const Handle& key);
+	virtual void storeAtoms(const HandleSeq&);
+	virtual void storeValues(const std::vector<std::pair<Handle,Handle>>&);
 	virtual void updateValue(const Handle& atom, const Handle& key,
 	                         const ValuePtr& delta);
 
@@ -93,6 +93,19 @@ void WriteThruProxy::storeValue(const Handle& atom, const Handle& key)
 		stnp->store_value(atom, key);
 }
 
+void WriteThruProxy::storeAtoms(const HandleSeq& atoms)
+{
+	for (const StorageNodePtr& stnp : _targets)
+		stnp->store_atoms(atoms);
+}
+
+void WriteThruProxy::storeValues(
+	const std::vector<std::pair<Handle, Handle>>& atom_keys)
+{
+	for (const StorageNodePtr& stnp : _targets)
+		stnp->store_values(atom_keys);
+}
+
 void WriteThruProxy::updateValue(const Handle& atom, const Handle& key,
                             const ValuePtr& delta)
 {
@@ -58,6 +58,8 @@ protected:
 	virtual void storeAtom(const Handle&, bool synchronous = false);
 	virtual void removeAtom(AtomSpace*, const Handle&, bool recursive);
 	virtual void storeValue(const Handle& atom, const Handle& key);
+	virtual void storeAtoms(const HandleSeq&);
+	virtual void storeValues(const std::vector<std::pair<Handle,Handle>>&);
 	virtual void updateValue(const Handle& atom, const Handle& key,
 	                         const ValuePtr& delta);
 	virtual void loadValue(const Handle& atom, const Handle& key) {}
@@ -0,0 +1,163 @@
+/*
+ * Binary.h
+ * Encoding and Decoding of Atomese in a compact binary format.
+ *
+ * Copyright (C) 2026 OpenCog Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _BINARY_ECODE_H
+#define _BINARY_ECODE_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <opencog/atoms/base/Handle.h>
+#include <opencog/atoms/value/Value.h>
+
+namespace opencog
+{
+/** \addtogroup grp_persist
+ *  @{
+ */
+
+/// Opcodes for the binary protocol. Each request frame starts with
+/// one of these, followed by the binary-encoded arguments. The TEXT
+/// opcode carries an ordinary s-expression command, and so provides
+/// access to the full command set; the others are binary versions of
+/// the hot-path commands used for AtomSpace replication.
+enum BinaryOp : uint8_t
+{
+	BIN_TEXT = 0,               // s-expr string -> reply string
+	BIN_GET_ATOMS,              // type, bool -> atom list
+	BIN_INCOMING_BY_TYPE,       // atom, type -> atom list
+	BIN_INCOMING_SET,           // atom -> atom list
+	BIN_KEYS_ALIST,             // atom -> alist
+	BIN_LINK,                   // atom -> atom or nil
+	BIN_NODE,                   // atom -> atom or nil
+	BIN_VALUE,                  // atom, key -> value
+	BIN_EXTRACT,                // atom -> bool
+	BIN_EXTRACT_RECURSIVE,      // atom -> bool
+	BIN_SET_VALUE,              // atom, key, value -> nothing
+	BIN_SET_VALUES,             // atom, alist -> nothing
+	BIN_UPDATE_VALUE,           // atom, key, value -> nothing
+	BIN_PING,                   // -> nothing much
+	BIN_NUM_OPS
+};
+
+/// Status byte at the start of each reply frame.
+enum BinaryStatus : uint8_t
+{
+	BIN_OK = 0,
+	BIN_ERROR = 1               // followed by the error message
+};
+
+/// Encoder and decoder for the binary wire format.
+///
+/// The format is deliberately simple:
+/// * Integers, lengths and counts are unsigned LEB128 varints.
+/// * Types are sent as their numeric Type. These are only meaningful
+///   if both ends agree on the type table; this is checked when the
+///   protocol is negotiated (see `type_table_hash()`).
+/// * Nodes are a type, followed by a length-prefixed name.
+/// * Links are a type, followed by the arity and the outgoing Atoms.
+/// * FloatValues are a type, a count, and then the raw IEEE-754
+///   doubles, in little-endian byte order.
+/// * BoolValues are a type, a count and then the packed bits.
+/// * StringValues are a type, a count, and length-prefixed strings.
+/// * LinkValues are a type, a count and then the Values.
+/// * The null Value is sent as NOTYPE.
+///
+/// Messages are framed by a varint byte-count prefix.
+///
+/// The cogserver shell splits its input into lines, and so frames
+/// cannot be sent as raw bytes; any newline or carriage return in them
+/// would be lost. On the wire, each frame is escaped, so that it has
+/// no newlines in it, and is sent as one line (see `encode_line()`).
+class Binary
+{
+public:
+	/// Protocol name sent during negotiation.
+	static const std::string protocol_version;
+
+	/// Hash of the names of all types, in numerical order. Two
+	/// AtomSpaces can exchange numeric types only if these agree.
+	static uint64_t type_table_hash(void);
+
+	static void encode_varint(std::string&, uint64_t);
+	static uint64_t decode_varint(const std::string&, size_t&);
+
+	static void encode_string(std::string&, const std::string&);
+	static std::string decode_string(const std::string&, size_t&);
+
+	static void encode_type(std::string& out, Type t) {
+		encode_varint(out, t); }
+	static Type decode_type(const std::string&, size_t&);
+
+	static void encode_bool(std::string& out, bool b) {
+		out.push_back(b ? 1 : 0); }
+	static bool decode_bool(const std::string&, size_t&);
+
+	static void encode_atom(std::string&, const Handle&);
+	static Handle decode_atom(const std::string&, size_t&);
+
+	static void encode_value(std::string&, const ValuePtr&);
+	static ValuePtr decode_value(const std::string&, size_t&);
+
+	template<typename SEQ>
+	static void encode_atoms(std::string& out, const SEQ& hseq) {
+		encode_varint(out, hseq.size());
+		for (const Handle& h : hseq) encode_atom(out, h);
+	}
+	static HandleSeq decode_atoms(const std::string&, size_t&);
+
+	/// All of the keys and values on an Atom.
+	static void encode_alist(std::string&, const Handle&);
+	static std::vector<std::pair<Handle, ValuePtr>>
+		decode_alist(const std::string&, size_t&);
+
+	/// Append `payload` to `out`, prefixed by its length.
+	static void encode_frame(std::string& out, const std::string& payload);
+
+	/// Extract the next complete frame from `buf`, starting at `pos`.
+	/// Returns false, and leaves `pos` unchanged, if the frame has not
+	/// yet been completely received.
+	static bool decode_frame(const std::string& buf, size_t& pos,
+	                         std::string& payload);
+
+	/// Escape character for the line encoding. It is followed by 'n'
+	/// for a newline, 'r' for a carriage return, and 'e' for itself.
+	static constexpr char ESCAPE = 0x1b;
+
+	/// Append the escaped `frame` to `out`, followed by a newline.
+	static void encode_line(std::string& out, const std::string& frame);
+
+	/// Undo `encode_line()`, appending the frame bytes to `out`. Raw
+	/// newlines and carriage returns are line separators, and are
+	/// dropped; the frame length prefix says where frames end. The
+	/// input may be split anywhere, even in the middle of an escape;
+	/// `esc` carries that state from one call to the next.
+	static void decode_line(std::string& out, const std::string& in,
+	                        bool& esc);
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _BINARY_ECODE_H
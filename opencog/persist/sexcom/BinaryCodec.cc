@@ -0,0 +1,462 @@
+/*
+ * BinaryCodec.cc
+ * Encoding and Decoding of Atomese in a compact binary format.
+ *
+ * Copyright (C) 2026 OpenCog Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cstring>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/atom_types/NameServer.h>
+#include <opencog/atoms/base/Link.h>
+#include <opencog/atoms/base/Node.h>
+#include <opencog/atoms/value/BoolValue.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+#include <opencog/atoms/value/VoidValue.h>
+#include <opencog/atoms/value/ValueFactory.h>
+
+#include "Binary.h"
+
+using namespace opencog;
+
+const std::string Binary::protocol_version = "binary-1";
+constexpr char Binary::ESCAPE;
+
+/* ================================================================== */
+
+/// FNV-1a hash of all of the type names. The std::hash is not used,
+/// because it is not guaranteed to be the same on both ends of the
+/// network connection.
+uint64_t Binary::type_table_hash(void)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	Type ntypes = nameserver().getNumberOfClasses();
+	for (Type t = 0; t < ntypes; t++)
+	{
+		const std::string& name = nameserver().getTypeName(t);
+		for (unsigned char c : name)
+		{
+			hash ^= c;
+			hash *= 0x100000001b3ULL;
+		}
+		// Separator, so that "ab","c" differs from "a","bc".
+		hash ^= 0xff;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/* ================================================================== */
+// Primitives
+
+// Written so that it cannot overflow, no matter how big N is.
+#define CHECK_AVAIL(BUF,POS,N) \
+	if ((BUF).size() < (POS) or (BUF).size() - (POS) < (N)) \
+		throw SyntaxException(TRACE_INFO, \
+			"Truncated binary message at %zu of %zu", (POS), (BUF).size());
+
+// Counts come off the wire; a hostile or corrupt count must not be
+// used to size an allocation. Each element takes at least ESZ bytes,
+// so there can't be more of them than there are bytes left.
+#define CHECK_COUNT(BUF,POS,CNT,ESZ) \
+	if ((BUF).size() < (POS) or ((BUF).size() - (POS)) / (ESZ) < (CNT)) \
+		throw SyntaxException(TRACE_INFO, \
+			"Bad count %zu at %zu of %zu", (size_t) (CNT), (POS), (BUF).size());
+
+void Binary::encode_varint(std::string& out, uint64_t val)
+{
+	while (0x80 <= val)
+	{
+		out.push_back((char) ((val & 0x7f) | 0x80));
+		val >>= 7;
+	}
+	out.push_back((char) val);
+}
+
+uint64_t Binary::decode_varint(const std::string& buf, size_t& pos)
+{
+	uint64_t val = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		CHECK_AVAIL(buf, pos, 1);
+		uint8_t byte = buf[pos++];
+		val |= ((uint64_t) (byte & 0x7f)) << shift;
+		if (0 == (byte & 0x80)) return val;
+	}
+	throw SyntaxException(TRACE_INFO, "Malformed varint at %zu", pos);
+}
+
+void Binary::encode_string(std::string& out, const std::string& str)
+{
+	encode_varint(out, str.size());
+	out.append(str);
+}
+
+std::string Binary::decode_string(const std::string& buf, size_t& pos)
+{
+	size_t len = decode_varint(buf, pos);
+	CHECK_AVAIL(buf, pos, len);
+	size_t start = pos;
+	pos += len;
+	return buf.substr(start, len);
+}
+
+Type Binary::decode_type(const std::string& buf, size_t& pos)
+{
+	uint64_t t = decode_varint(buf, pos);
+	if (nameserver().getNumberOfClasses() <= t)
+		throw SyntaxException(TRACE_INFO, "Unknown type %lu", t);
+	return (Type) t;
+}
+
+bool Binary::decode_bool(const std::string& buf, size_t& pos)
+{
+	CHECK_AVAIL(buf, pos, 1);
+	return 0 != buf[pos++];
+}
+
+/* ================================================================== */
+// Atoms
+
+void Binary::encode_atom(std::string& out, const Handle& h)
+{
+	encode_type(out, h->get_type());
+	if (h->is_node())
+	{
+		encode_string(out, h->get_name());
+		return;
+	}
+
+	encode_varint(out, h->get_arity());
+	for (const Handle& ho : h->getOutgoingSet())
+		encode_atom(out, ho);
+}
+
+// Atoms and LinkValues nest. A peer could send a frame that is nothing
+// but nested Link headers, and overflow the stack; so limit the depth.
+#define MAX_DEPTH 1024
+
+static void check_depth(size_t depth)
+{
+	if (MAX_DEPTH < depth)
+		throw SyntaxException(TRACE_INFO,
+			"Nested more than %d deep", MAX_DEPTH);
+}
+
+/// Decode the body of an Atom, i.e. everything after the type.
+/// The null Atom is not allowed in an outgoing set.
+static Handle decode_atom_body(Type t, const std::string& buf, size_t& pos,
+                               size_t depth)
+{
+	check_depth(depth);
+	if (nameserver().isA(t, NODE))
+		return createNode(t, Binary::decode_string(buf, pos));
+
+	if (not nameserver().isA(t, LINK))
+		throw SyntaxException(TRACE_INFO, "Not an Atom type: %s",
+			nameserver().getTypeName(t).c_str());
+
+	size_t arity = Binary::decode_varint(buf, pos);
+	CHECK_COUNT(buf, pos, arity, 1);
+	HandleSeq oset;
+	oset.reserve(arity);
+	for (size_t i = 0; i < arity; i++)
+	{
+		Type ot = Binary::decode_type(buf, pos);
+		if (NOTYPE == ot)
+			throw SyntaxException(TRACE_INFO,
+				"Null Atom in the outgoing set of a %s",
+				nameserver().getTypeName(t).c_str());
+		oset.emplace_back(decode_atom_body(ot, buf, pos, depth+1));
+	}
+	return createLink(std::move(oset), t);
+}
+
+Handle Binary::decode_atom(const std::string& buf, size_t& pos)
+{
+	Type t = decode_type(buf, pos);
+	if (NOTYPE == t) return Handle::UNDEFINED;
+	return decode_atom_body(t, buf, pos, 0);
+}
+
+HandleSeq Binary::decode_atoms(const std::string& buf, size_t& pos)
+{
+	size_t cnt = decode_varint(buf, pos);
+	CHECK_COUNT(buf, pos, cnt, 1);
+	HandleSeq hseq;
+	hseq.reserve(cnt);
+	for (size_t i = 0; i < cnt; i++)
+		hseq.emplace_back(decode_atom(buf, pos));
+	return hseq;
+}
+
+/* ================================================================== */
+// Values
+
+void Binary::encode_value(std::string& out, const ValuePtr& v)
+{
+	if (nullptr == v)
+	{
+		encode_type(out, NOTYPE);
+		return;
+	}
+
+	Type typ = v->get_type();
+	if (nameserver().isA(typ, ATOM))
+	{
+		encode_atom(out, HandleCast(v));
+		return;
+	}
+
+	encode_type(out, typ);
+	if (nameserver().isA(typ, FLOAT_VALUE))
+	{
+		const std::vector<double>& fl = FloatValueCast(v)->value();
+		encode_varint(out, fl.size());
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		out.append((const char*) fl.data(), fl.size() * sizeof(double));
+#else
+		for (double d : fl)
+		{
+			uint64_t u;
+			memcpy(&u, &d, sizeof(u));
+			for (int i = 0; i < 8; i++)
+				out.push_back((char) (u >> (8*i)));
+		}
+#endif
+		return;
+	}
+
+	if (nameserver().isA(typ, BOOL_VALUE))
+	{
+		BoolValuePtr bv(BoolValueCast(v));
+		size_t nbits = bv->size();
+		encode_varint(out, nbits);
+		uint8_t byte = 0;
+		for (size_t i = 0; i < nbits; i++)
+		{
+			if (bv->get_bit(i)) byte |= (1 << (i%8));
+			if (7 == i%8) { out.push_back((char) byte); byte = 0; }
+		}
+		if (0 != nbits%8) out.push_back((char) byte);
+		return;
+	}
+
+	if (nameserver().isA(typ, STRING_VALUE))
+	{
+		const std::vector<std::string>& sl = StringValueCast(v)->value();
+		encode_varint(out, sl.size());
+		for (const std::string& s : sl)
+			encode_string(out, s);
+		return;
+	}
+
+	if (nameserver().isA(typ, LINK_VALUE))
+	{
+		const std::vector<ValuePtr>& vl = LinkValueCast(v)->value();
+		encode_varint(out, vl.size());
+		for (const ValuePtr& vp : vl)
+			encode_value(out, vp);
+		return;
+	}
+
+	if (nameserver().isA(typ, VOID_VALUE))
+		return;
+
+	throw RuntimeException(TRACE_INFO, "Unsupported encode of Value %s",
+		nameserver().getTypeName(typ).c_str());
+}
+
+static ValuePtr decode_value_body(Type vtype, const std::string& buf,
+                                  size_t& pos, size_t depth)
+{
+	check_depth(depth);
+	if (nameserver().isA(vtype, ATOM))
+		return decode_atom_body(vtype, buf, pos, depth);
+
+	if (nameserver().isA(vtype, FLOAT_VALUE))
+	{
+		size_t cnt = Binary::decode_varint(buf, pos);
+		CHECK_COUNT(buf, pos, cnt, sizeof(double));
+		std::vector<double> fv(cnt);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		memcpy(fv.data(), buf.data() + pos, cnt * sizeof(double));
+#else
+		for (size_t j = 0; j < cnt; j++)
+		{
+			uint64_t u = 0;
+			for (int i = 0; i < 8; i++)
+				u |= ((uint64_t) (uint8_t) buf[pos + 8*j + i]) << (8*i);
+			memcpy(&fv[j], &u, sizeof(u));
+		}
+#endif
+		pos += cnt * sizeof(double);
+		return valueserver().create(vtype, std::move(fv));
+	}
+
+	if (nameserver().isA(vtype, BOOL_VALUE))
+	{
+		size_t nbits = Binary::decode_varint(buf, pos);
+		size_t nbytes = nbits / 8 + (0 != nbits % 8);
+		CHECK_AVAIL(buf, pos, nbytes);
+		std::vector<bool> bv(nbits);
+		for (size_t i = 0; i < nbits; i++)
+			bv[i] = (((uint8_t) buf[pos + i/8]) >> (i%8)) & 1;
+		pos += nbytes;
+		return valueserver().create(vtype, std::move(bv));
+	}
+
+	if (nameserver().isA(vtype, STRING_VALUE))
+	{
+		size_t cnt = Binary::decode_varint(buf, pos);
+		CHECK_COUNT(buf, pos, cnt, 1);
+		std::vector<std::string> sv;
+		sv.reserve(cnt);
+		for (size_t i = 0; i < cnt; i++)
+			sv.emplace_back(Binary::decode_string(buf, pos));
+		return valueserver().create(vtype, std::move(sv));
+	}
+
+	if (nameserver().isA(vtype, LINK_VALUE))
+	{
+		size_t cnt = Binary::decode_varint(buf, pos);
+		CHECK_COUNT(buf, pos, cnt, 1);
+		std::vector<ValuePtr> vv;
+		vv.reserve(cnt);
+		for (size_t i = 0; i < cnt; i++)
+		{
+			Type t = Binary::decode_type(buf, pos);
+			if (NOTYPE == t) vv.emplace_back(nullptr);
+			else vv.emplace_back(decode_value_body(t, buf, pos, depth+1));
+		}
+		return valueserver().create(vtype, std::move(vv));
+	}
+
+	if (nameserver().isA(vtype, VOID_VALUE))
+		return createVoidValue();
+
+	throw SyntaxException(TRACE_INFO, "Unsupported decode of Value %s",
+		nameserver().getTypeName(vtype).c_str());
+}
+
+ValuePtr Binary::decode_value(const std::string& buf, size_t& pos)
+{
+	Type vtype = decode_type(buf, pos);
+	if (NOTYPE == vtype) return nullptr;
+	return decode_value_body(vtype, buf, pos, 0);
+}
+
+/* ================================================================== */
+// Association lists
+
+void Binary::encode_alist(std::string& out, const Handle& h)
+{
+	HandleSet keys = h->getKeys();
+	encode_varint(out, keys.size());
+	for (const Handle& key : keys)
+	{
+		encode_atom(out, key);
+		encode_value(out, h->getValue(key));
+	}
+}
+
+std::vector<std::pair<Handle, ValuePtr>>
+Binary::decode_alist(const std::string& buf, size_t& pos)
+{
+	size_t cnt = decode_varint(buf, pos);
+	CHECK_COUNT(buf, pos, cnt, 2);
+	std::vector<std::pair<Handle, ValuePtr>> alist;
+	alist.reserve(cnt);
+	for (size_t i = 0; i < cnt; i++)
+	{
+		Handle key = decode_atom(buf, pos);
+		alist.emplace_back(key, decode_value(buf, pos));
+	}
+	return alist;
+}
+
+/* ================================================================== */
+// Framing
+
+void Binary::encode_frame(std::string& out, const std::string& payload)
+{
+	encode_varint(out, payload.size());
+	out.append(payload);
+}
+
+bool Binary::decode_frame(const std::string& buf, size_t& pos,
+                          std::string& payload)
+{
+	// Decode the length by hand, so that a partially-received
+	// length prefix is not mistaken for an error.
+	size_t p = pos;
+	uint64_t len = 0;
+	for (int shift = 0; ; shift += 7)
+	{
+		if (buf.size() <= p) return false;
+		if (64 <= shift)
+			throw SyntaxException(TRACE_INFO, "Malformed frame length");
+		uint8_t byte = buf[p++];
+		len |= ((uint64_t) (byte & 0x7f)) << shift;
+		if (0 == (byte & 0x80)) break;
+	}
+
+	if (buf.size() - p < len) return false;
+	payload = buf.substr(p, len);
+	pos = p + len;
+	return true;
+}
+
+void Binary::encode_line(std::string& out, const std::string& frame)
+{
+	out.reserve(out.size() + frame.size() + 1);
+	for (char c : frame)
+	{
+		if ('\n' == c) { out.push_back(ESCAPE); out.push_back('n'); }
+		else if ('\r' == c) { out.push_back(ESCAPE); out.push_back('r'); }
+		else if (ESCAPE == c) { out.push_back(ESCAPE); out.push_back('e'); }
+		else out.push_back(c);
+	}
+	out.push_back('\n');
+}
+
+void Binary::decode_line(std::string& out, const std::string& in, bool& esc)
+{
+	for (char c : in)
+	{
+		if ('\n' == c or '\r' == c) continue;
+		if (not esc)
+		{
+			if (ESCAPE == c) esc = true;
+			else out.push_back(c);
+			continue;
+		}
+		esc = false;
+		if ('n' == c) out.push_back('\n');
+		else if ('r' == c) out.push_back('\r');
+		else if ('e' == c) out.push_back(ESCAPE);
+		else
+			throw SyntaxException(TRACE_INFO,
+				"Bad escape in binary line: 0x%x", (unsigned) (uint8_t) c);
+	}
+}
+
+/* ============================= END OF FILE ================= */
@@ -0,0 +1,250 @@
+/*
+ * BinaryCommands.cc
+ * Binary versions of the basic AtomSpace commands.
+ *
+ * Copyright (C) 2026 OpenCog Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/atom_types/NameServer.h>
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/persist/proxy/ProxyNode.h>
+
+#include "Binary.h"
+#include "Commands.h"
+
+using namespace opencog;
+
+/// The binary protocol carries the same Atoms and Values as the
+/// s-expression protocol, but avoids printing and re-parsing them.
+/// Types are sent as small integers, outgoing sets as varint-counted
+/// lists, and FloatValues as raw arrays of doubles. See `Binary.h`
+/// for the encoding, and `Dispatcher::interpret_binary()` for the
+/// framing.
+///
+/// AtomSpace frames are not (yet) supported by the binary protocol;
+/// all commands apply to the base AtomSpace. Negotiation is refused
+/// if frames are in use, and so is every binary command, if frames
+/// come into use later on.
+
+// Frames are not supported in binary. The check is made for every
+// command, as a `define` may arrive after the protocol switch.
+AtomSpace* Commands::binary_space(void)
+{
+	if (_multi_space)
+		throw SyntaxException(TRACE_INFO,
+			"AtomSpace frames are in use; use the text protocol");
+	return _base_space.get();
+}
+
+// NOTYPE decodes as the null Atom. That's a valid Value, but it is
+// not a valid argument to any of the commands below.
+static Handle decode_arg(const std::string& msg, size_t& pos)
+{
+	Handle h = Binary::decode_atom(msg, pos);
+	if (nullptr == h)
+		throw SyntaxException(TRACE_INFO,
+			"Expecting an Atom at byte %zu", pos);
+	return h;
+}
+
+// -----------------------------------------------
+// (cog-protocol "binary-1" "a1b2c3d4e5f60718")
+// Negotiate a switch to the binary protocol. The second argument is
+// the hex-encoded `Binary::type_table_hash()` of the sender. Replies
+// with `#t` if the switch is acceptable, and `#f` if not. In either
+// case, the text protocol stays in effect until the caller switches.
+std::string Commands::cog_protocol(const std::string& cmd)
+{
+	size_t pos = cmd.find('"');
+	if (std::string::npos == pos) return "#f";
+	size_t epos = cmd.find('"', pos+1);
+	if (std::string::npos == epos) return "#f";
+	if (cmd.substr(pos+1, epos-pos-1) != Binary::protocol_version)
+		return "#f";
+
+	pos = cmd.find('"', epos+1);
+	if (std::string::npos == pos) return "#f";
+	epos = cmd.find('"', pos+1);
+	if (std::string::npos == epos) return "#f";
+
+	uint64_t hash = 0;
+	try { hash = std::stoull(cmd.substr(pos+1, epos-pos-1), nullptr, 16); }
+	catch (const std::exception&) { return "#f"; }
+	if (hash != Binary::type_table_hash()) return "#f";
+
+	if (_multi_space) return "#f";
+	return "#t";
+}
+
+// -----------------------------------------------
+// Methods that read
+
+std::string Commands::bin_get_atoms(const std::string& msg)
+{
+	size_t pos = 0;
+	Type t = Binary::decode_type(msg, pos);
+	bool get_subtypes = Binary::decode_bool(msg, pos);
+	binary_space();
+
+	std::string rv;
+	Binary::encode_atoms(rv, get_atoms(t, get_subtypes));
+	return rv;
+}
+
+std::string Commands::bin_incoming_by_type(const std::string& msg)
+{
+	size_t pos = 0;
+	Handle h = decode_arg(msg, pos);
+	Type t = Binary::decode_type(msg, pos);
+
+	std::string rv;
+	Binary::encode_atoms(rv, get_incoming_by_type(h, t, binary_space()));
+	return rv;
+}
+
+std::string Commands::bin_incoming_set(const std::string& msg)
+{
+	size_t pos = 0;
+	Handle h = decode_arg(msg, pos);
+
+	std::string rv;
+	Binary::encode_atoms(rv, get_incoming_set(h, binary_space()));
+	return rv;
+}
+
+std::string Commands::bin_keys_alist(const std::string& msg)
+{
+	size_t pos = 0;
+	Handle h = decode_arg(msg, pos);
+	h = get_keys(h, binary_space());
+
+	std::string rv;
+	Binary::encode_alist(rv, h);
+	return rv;
+}
+
+// Both cog-node and cog-link; the Atom is sent the same way for both.
+std::string Commands::bin_get_atom(const std::string& msg)
+{
+	size_t pos = 0;
+	Handle h = decode_arg(msg, pos);
+
+	AtomSpace* as = binary_space();
+	Type t = h->get_type();
+	if (h->is_node())
+		h = get_node(t, std::string(h->get_name()), as);
+	else
+		h = get_link(t, HandleSeq(h->getOutgoingSet()), as);
+
+	std::string rv;
+	Binary::encode_value(rv, h);
+	return rv;
+}
+
+std::string Commands::bin_value(const std::string& msg)
+{
+	size_t pos = 0;
+	Handle atom = decode_arg(msg, pos);
+	Handle key = decode_arg(msg, pos);
+
+	std::string rv;
+	Binary::encode_value(rv, get_value(atom, key, binary_space()));
+	return rv;
+}
+
+// -----------------------------------------------
+// Methods that write
+
+std::string Commands::bin_extract(const std::string& msg)
+{
+	size_t pos = 0;
+	binary_space();
+	std::string rv;
+	Binary::encode_bool(rv, extract(decode_arg(msg, pos), false));
+	return rv;
+}
+
+std::string Commands::bin_extract_recursive(const std::string& msg)
+{
+	size_t pos = 0;
+	binary_space();
+	std::string rv;
+	Binary::encode_bool(rv, extract(decode_arg(msg, pos), true));
+	return rv;
+}
+
+std::string Commands::bin_set_value(const std::string& msg)
+{
+	size_t pos = 0;
+	Handle atom = decode_arg(msg, pos);
+	Handle key = decode_arg(msg, pos);
+	ValuePtr vp = Binary::decode_value(msg, pos);
+
+	set_value(atom, key, vp, binary_space());
+	return "";
+}
+
+std::string Commands::bin_set_values(const std::string& msg)
+{
+	size_t pos = 0;
+	Handle h = decode_arg(msg, pos);
+	auto alist = Binary::decode_alist(msg, pos);
+	for (const auto& kv : alist)
+		if (nullptr == kv.first)
+			throw SyntaxException(TRACE_INFO, "Expecting an Atom as key");
+
+	AtomSpace* as = binary_space();
+	h = as->add_atom(h);
+	for (const auto& kv : alist)
+	{
+		ValuePtr vp = kv.second;
+		if (vp) vp = as->add_atoms(vp);
+		as->set_value(h, as->add_atom(kv.first), vp);
+	}
+
+	if (_proxy and _proxy->have_storeAtom)
+		_proxy->store_atom(h);
+
+	return "";
+}
+
+std::string Commands::bin_update_value(const std::string& msg)
+{
+	size_t pos = 0;
+	Handle atom = decode_arg(msg, pos);
+	Handle key = decode_arg(msg, pos);
+	ValuePtr vp = Binary::decode_value(msg, pos);
+
+	update_value(atom, key, vp, binary_space());
+	return "";
+}
+
+// -----------------------------------------------
+// Misc
+
+std::string Commands::bin_ping(const std::string& msg)
+{
+	std::string rv;
+	Binary::encode_varint(rv, 0);
+	return rv;
+}
+
+// ===================================================================
@@ -22,8 +22,10 @@
 
 #include <time.h>
 
+#include <cstdlib>
 #include <functional>
 #include <iomanip>
+#include <sstream>
 #include <string>
 
 #include <opencog/atoms/atom_types/NameServer.h>
@@ -53,11 +55,17 @@ using namespace opencog;
 /// is guaranteed to send only these commands, and no others.
 //
 
-Commands::Commands(void) : _multi_space(false) {}
+Commands::Commands(void) : _multi_space(false), _chunk_size(1000) {}
 Commands::~Commands() {}
 
 /// Search for optional AtomSpace argument in `cmd` at `pos`.
 /// If none is found, then return `as`
+///
+/// The AtomSpace can be given either in full, as a frame expression
+/// `(AtomSpace "foo" (AtomSpace "bar"))`, or in abbreviated form, as
+/// `(AtomSpace 5)`, with the frame ID that `cog-frame-ids` handed out.
+/// Either way, frames that have been seen before are found with a
+/// hash-table lookup, and not by searching the DAG.
 AtomSpace*
 Commands::get_opt_as(const std::string& cmd, size_t& pos)
 {
@@ -69,11 +77,39 @@ Commands::get_opt_as(const std::string& cmd, size_t& pos)
 	if (cmd.compare(pos, 10, "(AtomSpace"))
 		return _base_space.get();
 
+	// Abbreviated form: a frame ID, instead of a name.
+	size_t ipos = cmd.find_first_not_of(" \n\t", pos+10);
+	if (std::string::npos != ipos and isdigit((unsigned char) cmd[ipos]))
+	{
+		char* end;
+		size_t id = strtoul(cmd.c_str() + ipos, &end, 10);
+		pos = cmd.find(')', end - cmd.c_str());
+		if (std::string::npos != pos) pos++;
+
+		std::lock_guard<std::mutex> lck(_frame_mtx);
+		if (_frame_ids.size() <= id or nullptr == _frame_ids[id])
+			throw SyntaxException(TRACE_INFO, "Unknown frame ID %lu", id);
+		return AtomSpaceCast(_frame_ids[id]).get();
+	}
+
 	// Ah! Optional AtomSpace! Try to handle it!
 	_multi_space = true;
+	std::lock_guard<std::mutex> lck(_frame_mtx);
 	Handle hasp = Sexpr::decode_frame(
 		HandleCast(_top_space), cmd, pos, _space_map);
-	return (AtomSpace*) hasp.get();
+	return AtomSpaceCast(hasp).get();
+}
+
+Handle Commands::decode_atom(const std::string& cmd, size_t& pos)
+{
+	std::lock_guard<std::mutex> lck(_frame_mtx);
+	return Sexpr::decode_atom(cmd, pos, _space_map);
+}
+
+Handle Commands::decode_atom(const std::string& cmd, size_t l, size_t r)
+{
+	std::lock_guard<std::mutex> lck(_frame_mtx);
+	return Sexpr::decode_atom(cmd, l, r, 0, _space_map);
 }
 
 // ==================================================================
@@ -107,7 +143,7 @@ std::string Commands::cog_set_proxy(const std::string& cmd)
 	if (_proxy) return "#f";
 
 	size_t pos = 0;
-	Handle h = Sexpr::decode_atom(cmd, pos, _space_map);
+	Handle h = decode_atom(cmd, pos);
 
 	// If it's not a proxy, its an error.
 	if (not h->is_type(PROXY_NODE))
@@ -151,16 +187,16 @@ std::string Commands::cog_proxy_close(const std::string& arg)
 std::string Commands::cog_execute_cache(const std::string& cmd)
 {
 	size_t pos = 0;
-	Handle query = Sexpr::decode_atom(cmd, pos, _space_map);
+	Handle query = decode_atom(cmd, pos);
 	query = _base_space->add_atom(query);
-	Handle key = Sexpr::decode_atom(cmd, ++pos, _space_map);
+	Handle key = decode_atom(cmd, ++pos);
 	key = _base_space->add_atom(key);
 
 	bool force = false;
 	pos = cmd.find_first_of('(', pos);
 	if (std::string::npos != pos)
 	{
-		Handle meta = Sexpr::decode_atom(cmd, pos, _space_map);
+		Handle meta = decode_atom(cmd, pos);
 		meta = _base_space->add_atom(meta);
 
 		// XXX Hacky .. store time in float value...
@@ -188,9 +224,40 @@ std::string Commands::cog_execute_cache(const std::string& cmd)
 	return Sexpr::encode_value(rslt);
 }
 
+// -----------------------------------------------
+// Print a list of Atoms, as an s-expression list. If a Writer is
+// provided, then the list is handed to it in chunks of `_chunk_size`
+// Atoms, so that the reply never needs to be held in RAM all at once.
+// The unwritten tail of the list is returned.
+template<typename SEQ>
+std::string Commands::stream_atoms(const SEQ& hseq, bool multi,
+                                   const Writer& writer)
+{
+	std::string rv = "(";
+	size_t cnt = 0;
+	for (const Handle& h: hseq)
+	{
+		rv += Sexpr::encode_atom(h, multi);
+		if (writer and _chunk_size <= ++cnt)
+		{
+			writer(rv);
+			rv.clear();
+			cnt = 0;
+		}
+	}
+	rv += ")";
+	return rv;
+}
+
 // -----------------------------------------------
 // (cog-get-atoms 'Node #t)
 std::string Commands::cog_get_atoms(const std::string& cmd)
+{
+	return cog_get_atoms_chunked(cmd, nullptr);
+}
+
+std::string Commands::cog_get_atoms_chunked(const std::string& cmd,
+                                            const Writer& writer)
 {
 	size_t pos = 0;
 	Type t = Sexpr::decode_type(cmd, pos);
@@ -200,6 +267,15 @@ std::string Commands::cog_get_atoms(const std::string& cmd)
 	if (std::string::npos != pos and cmd.compare(pos, 2, "#f"))
 		get_subtypes = true;
 
+	// as = get_opt_as(cmd, pos, as);
+
+	// The HandleSeq is just pointers; it's the printed strings that
+	// are big. Those are streamed out, if a writer was given.
+	return stream_atoms(get_atoms(t, get_subtypes), _multi_space, writer);
+}
+
+HandleSeq Commands::get_atoms(Type t, bool get_subtypes)
+{
 	if (_proxy and _proxy->have_loadType)
 	{
 		_proxy->fetch_all_atoms_of_type(t);
@@ -215,31 +291,37 @@ std::string Commands::cog_get_atoms(const std::string& cmd)
 		_proxy->barrier();
 	}
 
-	// as = get_opt_as(cmd, pos, as);
-
-	std::string rv = "(";
 	HandleSeq hset;
 	if (_multi_space and _top_space)
 		_top_space->get_handles_by_type(hset, t, get_subtypes);
 	else
 		_base_space->get_handles_by_type(hset, t, get_subtypes);
-	for (const Handle& h: hset)
-		rv += Sexpr::encode_atom(h, _multi_space);
-	rv += ")";
-	return rv;
+	return hset;
 }
 
 // -----------------------------------------------
 // (cog-incoming-by-type (Concept "foo") 'ListLink)
 std::string Commands::cog_incoming_by_type(const std::string& cmd)
+{
+	return cog_incoming_by_type_chunked(cmd, nullptr);
+}
+
+std::string Commands::cog_incoming_by_type_chunked(const std::string& cmd,
+                                                   const Writer& writer)
 {
 	size_t pos = 0;
-	Handle h = Sexpr::decode_atom(cmd, pos, _space_map);
+	Handle h = decode_atom(cmd, pos);
 	pos++; // step past close-paren
 	Type t = Sexpr::decode_type(cmd, pos);
 
 	AtomSpace* as = get_opt_as(cmd, pos);
-	h = as->add_atom(h); // XXX shouldn't this be get_atom!????
+	return stream_atoms(get_incoming_by_type(h, t, as), false, writer);
+}
+
+IncomingSet Commands::get_incoming_by_type(const Handle& ha, Type t,
+                                           AtomSpace* as)
+{
+	Handle h = as->add_atom(ha); // XXX shouldn't this be get_atom!????
 
 	if (_proxy and _proxy->have_fetchIncomingByType)
 	{
@@ -247,36 +329,38 @@ std::string Commands::cog_incoming_by_type(const std::string& cmd)
 		_proxy->barrier();
 	}
 
-	std::string alist = "(";
-	for (const Handle& hi : h->getIncomingSetByType(t))
-		alist += Sexpr::encode_atom(hi);
-
-	alist += ")";
-	return alist;
+	return h->getIncomingSetByType(t);
 }
 
 // -----------------------------------------------
 // (cog-incoming-set (Concept "foo"))
 std::string Commands::cog_incoming_set(const std::string& cmd)
+{
+	return cog_incoming_set_chunked(cmd, nullptr);
+}
+
+std::string Commands::cog_incoming_set_chunked(const std::string& cmd,
+                                               const Writer& writer)
 {
 	size_t pos = 0;
-	Handle h = Sexpr::decode_atom(cmd, pos, _space_map);
+	Handle h = decode_atom(cmd, pos);
 	AtomSpace* as = get_opt_as(cmd, pos);
+	return stream_atoms(get_incoming_set(h, as), false, writer);
+}
 
+IncomingSet Commands::get_incoming_set(const Handle& ha, AtomSpace* as)
+{
+	Handle h;
 	if (_proxy and _proxy->have_fetchIncomingSet)
 	{
-		h = _proxy->fetch_incoming_set(h, false, as);
+		h = _proxy->fetch_incoming_set(ha, false, as);
 		_proxy->barrier();
 	}
 	else
-		h = as->get_atom(h);
-
-	std::string alist = "(";
-	for (const Handle& hi : h->getIncomingSet())
-		alist += Sexpr::encode_atom(hi);
+		h = as->get_atom(ha);
 
-	alist += ")";
-	return alist;
+	if (nullptr == h) return IncomingSet();
+	return h->getIncomingSet();
 }
 
 // -----------------------------------------------
@@ -284,15 +368,9 @@ std::string Commands::cog_incoming_set(const std::string& cmd)
 std::string Commands::cog_keys_alist(const std::string& cmd)
 {
 	size_t pos = 0;
-	Handle h = Sexpr::decode_atom(cmd, pos, _space_map);
+	Handle h = decode_atom(cmd, pos);
 	AtomSpace* as = get_opt_as(cmd, pos);
-	h = as->add_atom(h); // XXX shouldn't this be get_atom!????
-
-	if (_proxy and _proxy->have_getAtom)
-	{
-		_proxy->fetch_atom(h);
-		_proxy->barrier();
-	}
+	h = get_keys(h, as);
 
 	std::string alist = "(";
 	for (const Handle& key : h->getKeys())
@@ -304,6 +382,19 @@ std::string Commands::cog_keys_alist(const std::string& cmd)
 	return alist;
 }
 
+/// Return the Atom, holding all of its Values.
+Handle Commands::get_keys(const Handle& ha, AtomSpace* as)
+{
+	Handle h = as->add_atom(ha); // XXX shouldn't this be get_atom!????
+
+	if (_proxy and _proxy->have_getAtom)
+	{
+		_proxy->fetch_atom(h);
+		_proxy->barrier();
+	}
+	return h;
+}
+
 // -----------------------------------------------
 // (cog-node 'Concept "foobar")
 std::string Commands::cog_node(const std::string& cmd)
@@ -315,21 +406,24 @@ std::string Commands::cog_node(const std::string& cmd)
 	size_t r = cmd.size();
 	std::string name = Sexpr::get_node_name(cmd, l, r, t);
 
-	std::string nam = name;
-	Handle h = createNode(t, std::move(nam));
+	AtomSpace* as = get_opt_as(cmd, r);
+	Handle h = get_node(t, std::move(name), as);
+
+	if (nullptr == h) return "#f\n";
+	return Sexpr::encode_atom(h, _multi_space);
+}
 
+Handle Commands::get_node(Type t, std::string&& name, AtomSpace* as)
+{
 	// ?????? XXX Is this right? Needs review
 	if (_proxy and _proxy->have_getAtom)
 	{
-		_proxy->fetch_atom(h);
+		std::string nam = name;
+		_proxy->fetch_atom(createNode(t, std::move(nam)));
 		_proxy->barrier();
 	}
 
-	AtomSpace* as = get_opt_as(cmd, r);
-	h = as->get_node(t, std::move(name));
-
-	if (nullptr == h) return "#f\n";
-	return Sexpr::encode_atom(h, _multi_space);
+	return as->get_node(t, std::move(name));
 }
 
 // -----------------------------------------------
@@ -348,26 +442,29 @@ std::string Commands::cog_link(const std::string& cmd)
 		size_t r1 = r;
 		Sexpr::get_next_expr(cmd, l1, r1, 0);
 		if (l1 == r1) break;
-		outgoing.push_back(Sexpr::decode_atom(cmd, l1, r1, 0, _space_map));
+		outgoing.push_back(decode_atom(cmd, l1, r1));
 		l = r1 + 1;
 		pos = r1;
 	}
 
-	HandleSeq oset = outgoing;
-	Handle h = createLink(std::move(oset), t);
+	AtomSpace* as = get_opt_as(cmd, pos);
+	Handle h = get_link(t, std::move(outgoing), as);
 
+	if (nullptr == h) return "#f\n";
+	return Sexpr::encode_atom(h, _multi_space);
+}
+
+Handle Commands::get_link(Type t, HandleSeq&& outgoing, AtomSpace* as)
+{
 	// ?????? XXX Is this right? Needs review
 	if (_proxy and _proxy->have_getAtom)
 	{
-		_proxy->fetch_atom(h);
+		HandleSeq oset = outgoing;
+		_proxy->fetch_atom(createLink(std::move(oset), t));
 		_proxy->barrier();
 	}
 
-	AtomSpace* as = get_opt_as(cmd, pos);
-	h = as->get_link(t, std::move(outgoing));
-
-	if (nullptr == h) return "#f\n";
-	return Sexpr::encode_atom(h, _multi_space);
+	return as->get_link(t, std::move(outgoing));
 }
 
 // -----------------------------------------------
@@ -375,12 +472,18 @@ std::string Commands::cog_link(const std::string& cmd)
 std::string Commands::cog_value(const std::string& cmd)
 {
 	size_t pos = 0;
-	Handle atom = Sexpr::decode_atom(cmd, pos, _space_map);
-	Handle key = Sexpr::decode_atom(cmd, ++pos, _space_map);
+	Handle atom = decode_atom(cmd, pos);
+	Handle key = decode_atom(cmd, ++pos);
 
 	AtomSpace* as = get_opt_as(cmd, pos);
-	atom = as->add_atom(atom); // XXX shouldn't this be get_atom!????
-	key = as->add_atom(key);
+	return Sexpr::encode_value(get_value(atom, key, as));
+}
+
+ValuePtr Commands::get_value(const Handle& ha, const Handle& hk,
+                             AtomSpace* as)
+{
+	Handle atom = as->add_atom(ha); // XXX shouldn't this be get_atom!????
+	Handle key = as->add_atom(hk);
 
 	if (_proxy and _proxy->have_loadValue)
 	{
@@ -388,8 +491,7 @@ std::string Commands::cog_value(const std::string& cmd)
 		_proxy->barrier();
 	}
 
-	ValuePtr vp = atom->getValue(key);
-	return Sexpr::encode_value(vp);
+	return atom->getValue(key);
 }
 
 // -----------------------------------------------
@@ -397,17 +499,23 @@ std::string Commands::cog_value(const std::string& cmd)
 std::string Commands::cog_extract(const std::string& cmd)
 {
 	size_t pos = 0;
-	Handle h = _base_space->get_atom(Sexpr::decode_atom(cmd, pos, _space_map));
-	if (nullptr == h) return "#t";
+	if (extract(decode_atom(cmd, pos), false))
+		return "#t";
+	return "#f";
+}
+
+bool Commands::extract(const Handle& ha, bool recursive)
+{
+	Handle h = _base_space->get_atom(ha);
+	if (nullptr == h) return true;
 
 	if (_proxy and _proxy->have_removeAtom)
 	{
-		_proxy->remove_atom(_base_space, h, false);
-		return "#t";
+		_proxy->remove_atom(_base_space, h, recursive);
+		return true;
 	}
 
-	if (_base_space->extract_atom(h, false)) return "#t";
-	return "#f";
+	return _base_space->extract_atom(h, recursive);
 }
 
 // -----------------------------------------------
@@ -415,16 +523,8 @@ std::string Commands::cog_extract(const std::string& cmd)
 std::string Commands::cog_extract_recursive(const std::string& cmd)
 {
 	size_t pos = 0;
-	Handle h =_base_space->get_atom(Sexpr::decode_atom(cmd, pos, _space_map));
-	if (nullptr == h) return "#t";
-
-	if (_proxy and _proxy->have_removeAtom)
-	{
-		_proxy->remove_atom(_base_space, h, true);
+	if (extract(decode_atom(cmd, pos), true))
 		return "#t";
-	}
-
-	if (_base_space->extract_atom(h, true)) return "#t";
 	return "#f";
 }
 
@@ -433,21 +533,26 @@ std::string Commands::cog_extract_recursive(const std::string& cmd)
 std::string Commands::cog_set_value(const std::string& cmd)
 {
 	size_t pos = 0;
-	Handle atom = Sexpr::decode_atom(cmd, pos, _space_map);
-	Handle key = Sexpr::decode_atom(cmd, ++pos, _space_map);
+	Handle atom = decode_atom(cmd, pos);
+	Handle key = decode_atom(cmd, ++pos);
 	ValuePtr vp = Sexpr::decode_value(cmd, ++pos);
 
 	AtomSpace* as = get_opt_as(cmd, pos);
-	atom = as->add_atom(atom);
-	key = as->add_atom(key);
+	set_value(atom, key, vp, as);
+	return "";
+}
+
+void Commands::set_value(const Handle& ha, const Handle& hk,
+                         ValuePtr vp, AtomSpace* as)
+{
+	Handle atom = as->add_atom(ha);
+	Handle key = as->add_atom(hk);
 	if (vp)
 		vp = Sexpr::add_atoms(as, vp);
 	as->set_value(atom, key, vp);
 
 	if (_proxy and _proxy->have_storeValue)
 		_proxy->store_value(atom, key);
-
-	return "";
 }
 
 // -----------------------------------------------
@@ -456,7 +561,7 @@ std::string Commands::cog_set_value(const std::string& cmd)
 std::string Commands::cog_set_values(const std::string& cmd)
 {
 	size_t pos = 0;
-	Handle h = Sexpr::decode_atom(cmd, pos, _space_map);
+	Handle h = decode_atom(cmd, pos);
 	pos++; // skip past close-paren
 
 	if (not _multi_space)
@@ -483,27 +588,33 @@ std::string Commands::cog_set_values(const std::string& cmd)
 std::string Commands::cog_update_value(const std::string& cmd)
 {
 	size_t pos = 0;
-	Handle atom = Sexpr::decode_atom(cmd, pos, _space_map);
-	Handle key = Sexpr::decode_atom(cmd, ++pos, _space_map);
+	Handle atom = decode_atom(cmd, pos);
+	Handle key = decode_atom(cmd, ++pos);
 	ValuePtr vp = Sexpr::decode_value(cmd, ++pos);
 
 	AtomSpace* as = get_opt_as(cmd, pos);
-	atom = as->add_atom(atom);
-	key = as->add_atom(key);
+	update_value(atom, key, vp, as);
 
-	if (not nameserver().isA(vp->get_type(), FLOAT_VALUE))
-		return "";
+	// Return the new value. XXX Why? This just wastes CPU?
+	// ValuePtr vp = atom->getValue(key);
+	// return Sexpr::encode_value(vp);
+	return "";
+}
+
+void Commands::update_value(const Handle& ha, const Handle& hk,
+                            const ValuePtr& vp, AtomSpace* as)
+{
+	Handle atom = as->add_atom(ha);
+	Handle key = as->add_atom(hk);
+
+	if (nullptr == vp or not nameserver().isA(vp->get_type(), FLOAT_VALUE))
+		return;
 
 	FloatValuePtr fvp = FloatValueCast(vp);
 	as->increment_count(atom, key, fvp->value());
 
 	if (_proxy and _proxy->have_updateValue)
 		_proxy->update_value(atom, key, vp);
-
-	// Return the new value. XXX Why? This just wastes CPU?
-	// ValuePtr vp = atom->getValue(key);
-	// return Sexpr::encode_value(vp);
-	return "";
 }
 
 // -----------------------------------------------
@@ -522,6 +633,7 @@ std::string Commands::cog_define(const std::string& cmd)
 	pos = epos+1;
 
 	// Decode the AtomSpace frames
+	std::lock_guard<std::mutex> lck(_frame_mtx);
 	Handle hasp = Sexpr::decode_frame(
 		HandleCast(_base_space), cmd, pos, _space_map);
 	_top_space = AtomSpaceCast(hasp);
@@ -532,6 +644,38 @@ std::string Commands::cog_define(const std::string& cmd)
 	return "";
 }
 
+// -----------------------------------------------
+// (cog-frame-ids) -- Assign numeric IDs to all known frames.
+// Returns an association list of names and IDs:
+//    (("foo" . 1) ("bar" . 2) ...)
+// The IDs are stable: once assigned, they never change. After this,
+// the abbreviated form `(AtomSpace 2)` can be used in place of the
+// full frame expression for "bar".
+std::string Commands::cog_frame_ids(const std::string& cmd)
+{
+	std::lock_guard<std::mutex> lck(_frame_mtx);
+
+	// ID zero is never used.
+	if (_frame_ids.empty()) _frame_ids.push_back(Handle::UNDEFINED);
+
+	for (const auto& pr : _space_map)
+	{
+		if (_frame_index.end() != _frame_index.find(pr.first)) continue;
+		_frame_index.insert({pr.first, _frame_ids.size()});
+		_frame_ids.push_back(pr.second);
+	}
+
+	std::string alist = "(";
+	for (size_t id = 1; id < _frame_ids.size(); id++)
+	{
+		std::stringstream ss;
+		ss << std::quoted(_frame_ids[id]->get_name());
+		alist += "(" + ss.str() + " . " + std::to_string(id) + ")";
+	}
+	alist += ")";
+	return alist;
+}
+
 // -----------------------------------------------
 // (ping) -- network ping
 std::string Commands::cog_ping(const std::string& cmd)
@@ -23,8 +23,11 @@
 #ifndef _COMMANDS_H
 #define _COMMANDS_H
 
+#include <functional>
 #include <map>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <opencog/atomspace/AtomSpace.h>
 #include <opencog/persist/proxy/ProxyNode.h>
@@ -38,6 +41,13 @@ namespace opencog
 
 class Commands
 {
+public:
+	/// Callback used to hand back long replies in pieces, instead of
+	/// accumulating them into one giant string. Each call delivers the
+	/// next chunk of the reply; the concatenation of all chunks, plus
+	/// the returned tail, is identical to the un-chunked reply.
+	typedef std::function<void (const std::string&)> Writer;
+
 protected:
 	ProxyNodePtr _proxy;
 	Handle _truth_key;
@@ -49,8 +59,21 @@ protected:
 	/// Map from string AtomSpace names to the matching AtomSpacePtr's
 	std::unordered_map<std::string, Handle> _space_map;
 
+	/// Frame registry: short numeric IDs for AtomSpaces, so that
+	/// commands can say `(AtomSpace 5)` instead of spelling out the
+	/// entire DAG. The IDs are handed out by `cog-frame-ids`.
+	/// The lock guards these, as well as the _space_map above, which
+	/// grows whenever a new frame is decoded.
+	std::mutex _frame_mtx;
+	std::vector<Handle> _frame_ids;
+	std::unordered_map<std::string, size_t> _frame_index;
+
 	AtomSpace* get_opt_as(const std::string&, size_t&);
 
+	/// Same as Sexpr::decode_atom(), using the _space_map under lock.
+	Handle decode_atom(const std::string&, size_t&);
+	Handle decode_atom(const std::string&, size_t, size_t);
+
 	/// AtomSpace to which all commands apply.
 	AtomSpacePtr _base_space;
 
@@ -59,6 +82,29 @@ protected:
 	/// not free the frame immediately after it is created.
 	AtomSpacePtr _top_space;
 
+	/// Number of Atoms per chunk, when replies are streamed.
+	size_t _chunk_size;
+
+	template<typename SEQ>
+	std::string stream_atoms(const SEQ&, bool, const Writer&);
+
+	/// The actual work, shared by the text and the binary protocols.
+	/// These perform any needed proxy fetches/stores.
+	HandleSeq get_atoms(Type, bool);
+	IncomingSet get_incoming_by_type(const Handle&, Type, AtomSpace*);
+	IncomingSet get_incoming_set(const Handle&, AtomSpace*);
+	Handle get_keys(const Handle&, AtomSpace*);
+	Handle get_node(Type, std::string&&, AtomSpace*);
+	Handle get_link(Type, HandleSeq&&, AtomSpace*);
+	ValuePtr get_value(const Handle&, const Handle&, AtomSpace*);
+	bool extract(const Handle&, bool);
+	void set_value(const Handle&, const Handle&, ValuePtr, AtomSpace*);
+	void update_value(const Handle&, const Handle&, const ValuePtr&,
+	                  AtomSpace*);
+
+	/// The AtomSpace for binary commands; throws if frames are in use.
+	AtomSpace* binary_space(void);
+
 public:
 	Commands(void);
 	~Commands();
@@ -66,6 +112,9 @@ public:
 	// Indicate which AtomSpace to use
 	void set_base_space(const AtomSpacePtr&);
 
+	// Set the number of Atoms per chunk, for streamed replies.
+	void set_chunk_size(size_t sz) { _chunk_size = sz; }
+
 	/// Methods that implement each of the interpreted commands.
 	std::string cog_atomspace(const std::string&);
 	std::string cog_atomspace_clear(const std::string&);
@@ -84,6 +133,13 @@ public:
 	std::string cog_node(const std::string&);
 	std::string cog_value(const std::string&);
 
+	/// Streaming variants of the above. These can return a very large
+	/// number of Atoms; the reply is passed to the Writer in chunks of
+	/// `_chunk_size` Atoms, and only the tail is returned.
+	std::string cog_get_atoms_chunked(const std::string&, const Writer&);
+	std::string cog_incoming_by_type_chunked(const std::string&, const Writer&);
+	std::string cog_incoming_set_chunked(const std::string&, const Writer&);
+
 	// Methods that write
 	std::string cog_extract(const std::string&);
 	std::string cog_extract_recursive(const std::string&);
@@ -95,6 +151,24 @@ public:
 	std::string cog_define(const std::string&);
 	std::string cog_ping(const std::string&);
 	std::string cog_version(const std::string&);
+	std::string cog_protocol(const std::string&);
+	std::string cog_frame_ids(const std::string&);
+
+	/// Binary versions of the commands above. The argument is the
+	/// request frame, minus the opcode byte; the return value is the
+	/// binary-encoded reply, minus the status byte. See Binary.h
+	std::string bin_get_atoms(const std::string&);
+	std::string bin_incoming_by_type(const std::string&);
+	std::string bin_incoming_set(const std::string&);
+	std::string bin_keys_alist(const std::string&);
+	std::string bin_get_atom(const std::string&);
+	std::string bin_value(const std::string&);
+	std::string bin_extract(const std::string&);
+	std::string bin_extract_recursive(const std::string&);
+	std::string bin_set_value(const std::string&);
+	std::string bin_set_values(const std::string&);
+	std::string bin_update_value(const std::string&);
+	std::string bin_ping(const std::string&);
 };
 
 /** @}*/
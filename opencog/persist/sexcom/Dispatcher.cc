@@ -20,12 +20,14 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <math.h>
 #include <time.h>
 
 #include <functional>
 #include <iomanip>
 #include <string>
 
+#include "Binary.h"
 #include "Dispatcher.h"
 #include "Commands.h"
 
@@ -48,12 +50,17 @@ Dispatcher::Dispatcher(void)
 {
 	using namespace std::placeholders;  // for _1, _2, _3...
 
+	static std::atomic<size_t> next_id(1);
+	_id = next_id.fetch_add(1);
+	_retired = std::make_shared<ThreadStats>();
+
 	// Fast dispatch. There should be zero hash collisions
 	// here. If there are, we are in trouble. (Well, if there
 	// are collisions, pre-pend the paren, post-pend the space.)
 #define MASH(HSH,STR,CB) \
    static const size_t HSH = std::hash<std::string>{}(STR); \
-   _dispatch_map.insert({HSH, std::bind(&Commands::CB, &_default, _1)});
+   _dispatch_map.insert({HSH, std::bind(&Commands::CB, &_default, _1)}); \
+   register_command(HSH, STR);
 
 	MASH(space, "cog-atomspace)",         cog_atomspace);
 	MASH(clear, "cog-atomspace-clear)",   cog_atomspace_clear);
@@ -79,6 +86,44 @@ Dispatcher::Dispatcher(void)
 	MASH(dfine, "define",                 cog_define);
 	MASH(ping,  "ping)",                  cog_ping);
 	MASH(versn, "cog-version)",           cog_version);
+	MASH(proto, "cog-protocol",           cog_protocol);
+	MASH(frids, "cog-frame-ids)",         cog_frame_ids);
+
+	// The stats live here, not in Commands.
+	static const size_t stats = std::hash<std::string>{}("cog-stats)");
+	_dispatch_map.insert({stats, std::bind(&Dispatcher::cog_stats, this, _1)});
+	register_command(stats, "cog-stats)");
+
+	// Commands that can stream their replies in chunks.
+#define SMASH(HSH,CB) \
+   _stream_map.insert({HSH, std::bind(&Commands::CB, &_default, _1, _2)});
+
+	SMASH(gtatm, cog_get_atoms_chunked);
+	SMASH(incty, cog_incoming_by_type_chunked);
+	SMASH(incom, cog_incoming_set_chunked);
+
+	// Binary opcodes. The text-command hash is recorded, so that the
+	// binary version can be disabled if the text command is over-ridden.
+#define BASH(OP,HSH,CB) \
+   _binary_table[OP] = std::bind(&Commands::CB, &_default, _1); \
+   _binary_ops.insert({HSH, OP}); \
+   _binary_index[OP] = _cmd_index[HSH];
+
+	_binary_table.resize(BIN_NUM_OPS);
+	_binary_index.resize(BIN_NUM_OPS, 0);
+	BASH(BIN_GET_ATOMS,         gtatm, bin_get_atoms);
+	BASH(BIN_INCOMING_BY_TYPE,  incty, bin_incoming_by_type);
+	BASH(BIN_INCOMING_SET,      incom, bin_incoming_set);
+	BASH(BIN_KEYS_ALIST,        keys,  bin_keys_alist);
+	BASH(BIN_LINK,              link,  bin_get_atom);
+	BASH(BIN_NODE,              node,  bin_get_atom);
+	BASH(BIN_VALUE,             value, bin_value);
+	BASH(BIN_EXTRACT,           extra, bin_extract);
+	BASH(BIN_EXTRACT_RECURSIVE, recur, bin_extract_recursive);
+	BASH(BIN_SET_VALUE,         stval, bin_set_value);
+	BASH(BIN_SET_VALUES,        svals, bin_set_values);
+	BASH(BIN_UPDATE_VALUE,      upval, bin_update_value);
+	BASH(BIN_PING,              ping,  bin_ping);
 }
 
 Dispatcher::~Dispatcher()
@@ -89,18 +134,29 @@ void Dispatcher::install_handler(const std::string& idstr, Meth handler)
 {
 	size_t idhash = std::hash<std::string>{}(idstr);
 	_dispatch_map.insert_or_assign(idhash, handler);
+	register_command(idhash, idstr);
+
+	// The over-ride must win, even when streaming.
+	_stream_map.erase(idhash);
+
+	// ... and it must win over the binary protocol, too.
+	const auto& bop = _binary_ops.find(idhash);
+	if (_binary_ops.end() != bop)
+		_binary_table[bop->second] = nullptr;
 }
 
 // -----------------------------------------------
 
-std::string Dispatcher::interpret_command(const std::string& cmd)
+/// Locate the command name at the start of `cmd`, and return its hash.
+/// Upon return, `pos` points at the start of the arguments, or is npos
+/// if there are none. Returns zero for blank lines and comments.
+size_t Dispatcher::find_command(const std::string& cmd, size_t& pos)
 {
-	// Find the command and dispatch
-	size_t pos = cmd.find_first_not_of(" \n\t");
-	if (std::string::npos == pos) return "";
+	pos = cmd.find_first_not_of(" \n\t");
+	if (std::string::npos == pos) return 0;
 
 	// Ignore comments
-	if (';' == cmd[pos]) return "";
+	if (';' == cmd[pos]) return 0;
 
 	if ('(' != cmd[pos])
 		throw SyntaxException(TRACE_INFO, "Badly formed command: %s",
@@ -119,19 +175,349 @@ std::string Dispatcher::interpret_command(const std::string& cmd)
 
 	// Look up the method to call, based on the hash of the command string.
 	size_t action = std::hash<std::string>{}(cmd.substr(pos, epos-pos));
-	const auto& disp = _dispatch_map.find(action);
+	if (_dispatch_map.end() == _dispatch_map.find(action))
+		throw SyntaxException(TRACE_INFO, "Command not supported: >>%s<<",
+			cmd.substr(pos, epos-pos).c_str());
 
-	if (_dispatch_map.end() != disp)
+	pos = cmd.find_first_not_of(" \n\t", epos);
+	return action;
+}
+
+std::string Dispatcher::interpret_command(const std::string& cmd)
+{
+	size_t pos;
+	size_t action = find_command(cmd, pos);
+	if (0 == action) return "";
+
+	auto start = std::chrono::steady_clock::now();
+	size_t idx = _cmd_index.at(action);
+	Meth& f = _dispatch_map.find(action)->second;
+	try
 	{
-		Meth f = disp->second;
-		pos = cmd.find_first_not_of(" \n\t", epos);
+		std::string rv;
 		if (cmd.npos != pos)
-			return f(cmd.substr(pos));
-		return f(""); // no arguments available.
+			rv = f(cmd.substr(pos));
+		else
+			rv = f(""); // no arguments available.
+		record(idx, start, false);
+		return rv;
+	}
+	catch (...)
+	{
+		record(idx, start, true);
+		throw;
+	}
+}
+
+std::string Dispatcher::interpret_command(const std::string& cmd,
+                                          const Commands::Writer& writer)
+{
+	size_t pos;
+	size_t action = find_command(cmd, pos);
+	if (0 == action) return "";
+
+	std::string args;
+	if (cmd.npos != pos) args = cmd.substr(pos);
+
+	auto start = std::chrono::steady_clock::now();
+	size_t idx = _cmd_index.at(action);
+	try
+	{
+		std::string rv;
+		const auto& sdisp = _stream_map.find(action);
+		if (_stream_map.end() != sdisp)
+			rv = sdisp->second(args, writer);
+		else
+			rv = _dispatch_map.find(action)->second(args);
+		record(idx, start, false);
+		return rv;
+	}
+	catch (...)
+	{
+		record(idx, start, true);
+		throw;
+	}
+}
+
+// -----------------------------------------------
+
+/// Build a reply frame: the length, then the status, then the reply.
+static std::string binary_reply(BinaryStatus status, const std::string& rep)
+{
+	std::string frame;
+	frame.reserve(rep.size() + 11);
+	Binary::encode_varint(frame, rep.size() + 1);
+	frame.push_back((char) status);
+	frame.append(rep);
+	return frame;
+}
+
+std::string Dispatcher::interpret_binary(const std::string& msg)
+{
+	if (msg.empty())
+		return binary_reply(BIN_ERROR, "Empty binary command");
+
+	uint8_t op = msg[0];
+	if (BIN_NUM_OPS <= op)
+		return binary_reply(BIN_ERROR,
+			"Unknown binary opcode " + std::to_string(op));
+
+	// The text commands record their own stats.
+	if (BIN_TEXT != op and nullptr == _binary_table[op])
+		return binary_reply(BIN_ERROR,
+			"Binary opcode " + std::to_string(op) +
+			" is not available; use text instead");
+
+	auto start = std::chrono::steady_clock::now();
+	std::string reply;
+	try
+	{
+		if (BIN_TEXT == op)
+			reply = interpret_command(msg.substr(1));
+		else
+		{
+			reply = _binary_table[op](msg.substr(1));
+			record(_binary_index[op], start, false);
+		}
+	}
+	catch (const StandardException& ex)
+	{
+		if (BIN_TEXT != op) record(_binary_index[op], start, true);
+		return binary_reply(BIN_ERROR, ex.what());
+	}
+	catch (const std::runtime_error& ex)
+	{
+		if (BIN_TEXT != op) record(_binary_index[op], start, true);
+		return binary_reply(BIN_ERROR, ex.what());
+	}
+
+	// Just like the text protocol: no reply, if there's nothing to say.
+	if (reply.empty()) return "";
+	return binary_reply(BIN_OK, reply);
+}
+
+bool Dispatcher::is_protocol_switch(const std::string& cmd,
+                                    const std::string& reply)
+{
+	if (0 != reply.compare(0, 2, "#t")) return false;
+	size_t pos = cmd.find_first_not_of(" \n\t");
+	if (std::string::npos == pos) return false;
+	return 0 == cmd.compare(pos, 13, "(cog-protocol");
+}
+
+// -----------------------------------------------
+// Performance instrumentation
+
+/// Assign a small index to the command. Index zero is reserved for
+/// the overflow bucket, in case there are more than MAX_COMMANDS.
+void Dispatcher::register_command(size_t hash, const std::string& name)
+{
+	std::lock_guard<std::mutex> lck(_stats_mtx);
+	if (_cmd_index.end() != _cmd_index.find(hash)) return;
+
+	if (_cmd_names.empty()) _cmd_names.push_back("other");
+	if (MAX_COMMANDS <= _cmd_names.size())
+	{
+		_cmd_index.insert({hash, 0});
+		return;
+	}
+
+	// The closing paren is part of the hash, but not the name.
+	std::string nam = name;
+	if (0 < nam.size() and ')' == nam.back()) nam.pop_back();
+	_cmd_index.insert({hash, _cmd_names.size()});
+	_cmd_names.push_back(nam);
+}
+
+/// Find the stats block for this thread, creating it if needed.
+/// The thread-local map holds a reference, so the block remains
+/// valid even if the thread outlives the Dispatcher (or vice-versa).
+Dispatcher::ThreadStats* Dispatcher::get_thread_stats(void)
+{
+	static thread_local std::unordered_map<size_t,
+		std::shared_ptr<ThreadStats>> tstats;
+
+	const auto& it = tstats.find(_id);
+	if (tstats.end() != it) return it->second.get();
+
+	// make_shared value-initializes, so all counters start at zero.
+	std::shared_ptr<ThreadStats> ts = std::make_shared<ThreadStats>();
+	tstats.insert({_id, ts});
+
+	std::lock_guard<std::mutex> lck(_stats_mtx);
+
+	// Fold in the stats of threads that have exited, so that the
+	// list does not grow without bound when threads come and go.
+	// If the registry holds the only reference, the thread is gone.
+	for (size_t i = 0; i < _thread_stats.size(); )
+	{
+		if (1 < _thread_stats[i].use_count()) { i++; continue; }
+		add_stats(*_retired, *_thread_stats[i]);
+		_thread_stats[i] = _thread_stats.back();
+		_thread_stats.pop_back();
+	}
+	_thread_stats.push_back(ts);
+	return ts.get();
+}
+
+/// Accumulate `from` into `to`. Caller must hold the lock.
+void Dispatcher::add_stats(ThreadStats& to, const ThreadStats& from)
+{
+	for (size_t i = 0; i < MAX_COMMANDS; i++)
+	{
+		CmdStats& tc = to.cmds[i];
+		const CmdStats& fc = from.cmds[i];
+		tc.count += fc.count.load(std::memory_order_relaxed);
+		tc.errors += fc.errors.load(std::memory_order_relaxed);
+		tc.nsecs += fc.nsecs.load(std::memory_order_relaxed);
+		for (size_t b = 0; b < NBUCKETS; b++)
+			tc.hist[b] += fc.hist[b].load(std::memory_order_relaxed);
+	}
+}
+
+void Dispatcher::record(size_t idx,
+                        const std::chrono::steady_clock::time_point& start,
+                        bool err)
+{
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	uint64_t nsecs =
+		std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+
+	// Bucket k holds durations less than 2^k microseconds.
+	uint64_t usecs = nsecs / 1000;
+	size_t bucket = 0;
+	while (usecs and bucket < NBUCKETS-1) { usecs >>= 1; bucket++; }
+
+	// Only this thread ever writes these, so a plain load and store
+	// is enough; no need for an expensive atomic read-modify-write.
+	CmdStats& cs = get_thread_stats()->cmds[idx];
+#define BUMP(CTR,N) CTR.store(CTR.load(std::memory_order_relaxed) + N, \
+                              std::memory_order_relaxed);
+	BUMP(cs.count, 1);
+	BUMP(cs.nsecs, nsecs);
+	BUMP(cs.hist[bucket], 1);
+	if (err) BUMP(cs.errors, 1);
+}
+
+/// Sum the stats over all threads, since the very beginning.
+/// Caller must hold the lock.
+std::vector<Dispatcher::StatsTotal> Dispatcher::sum_raw(void)
+{
+	std::vector<StatsTotal> totals(_cmd_names.size());
+
+	std::vector<ThreadStats*> all;
+	all.push_back(_retired.get());
+	for (const auto& ts : _thread_stats)
+		all.push_back(ts.get());
+
+	for (size_t i = 0; i < _cmd_names.size(); i++)
+	{
+		StatsTotal& st = totals[i];
+		st.name = _cmd_names[i];
+		st.hist.resize(NBUCKETS, 0);
+		for (const ThreadStats* ts : all)
+		{
+			const CmdStats& cs = ts->cmds[i];
+			st.count += cs.count.load(std::memory_order_relaxed);
+			st.errors += cs.errors.load(std::memory_order_relaxed);
+			st.nsecs += cs.nsecs.load(std::memory_order_relaxed);
+			for (size_t b = 0; b < NBUCKETS; b++)
+				st.hist[b] += cs.hist[b].load(std::memory_order_relaxed);
+		}
+	}
+	return totals;
+}
+
+/// Sum the stats over all threads, since the last clear_stats().
+/// The raw counters only ever go up, so this never goes negative.
+std::vector<Dispatcher::StatsTotal> Dispatcher::sum_stats(void)
+{
+	std::lock_guard<std::mutex> lck(_stats_mtx);
+	std::vector<StatsTotal> totals = sum_raw();
+	for (size_t i = 0; i < _baseline.size() and i < totals.size(); i++)
+	{
+		StatsTotal& st = totals[i];
+		const StatsTotal& base = _baseline[i];
+		st.count -= base.count;
+		st.errors -= base.errors;
+		st.nsecs -= base.nsecs;
+		for (size_t b = 0; b < NBUCKETS; b++)
+			st.hist[b] -= base.hist[b];
 	}
+	return totals;
+}
+
+// -----------------------------------------------
+// (cog-stats)
+// Returns a list, one entry per command that has been called:
+// ((cog-value (count . 42) (errors . 0) (usecs . 371) (hist 0 2 40 ...)) ...)
+// The histogram is trimmed after the last non-zero bucket.
+std::string Dispatcher::cog_stats(const std::string& arg)
+{
+	std::vector<StatsTotal> totals = sum_stats();
+
+	std::string rv = "(";
+	for (size_t i = 0; i < totals.size(); i++)
+	{
+		const StatsTotal& st = totals[i];
+		if (0 == st.count) continue;
+
+		size_t last = NBUCKETS;
+		while (0 < last and 0 == st.hist[last-1]) last--;
 
-	throw SyntaxException(TRACE_INFO, "Command not supported: >>%s<<",
-		cmd.substr(pos, epos-pos).c_str());
+		rv += "(" + st.name;
+		rv += " (count . " + std::to_string(st.count) + ")";
+		rv += " (errors . " + std::to_string(st.errors) + ")";
+		rv += " (usecs . " + std::to_string(st.nsecs / 1000) + ")";
+		rv += " (hist";
+		for (size_t b = 0; b < last; b++)
+			rv += " " + std::to_string(st.hist[b]);
+		rv += "))";
+	}
+	rv += ")";
+	return rv;
+}
+
+std::string Dispatcher::monitor(void)
+{
+	std::vector<StatsTotal> totals = sum_stats();
+
+	std::string rpt = "Dispatcher stats:\n";
+	rpt += "command                     count  errors   avg-usec   p50<   p99<\n";
+
+	char buf[200];
+	for (size_t i = 0; i < totals.size(); i++)
+	{
+		const StatsTotal& st = totals[i];
+		if (0 == st.count) continue;
+
+		// Percentiles, to the resolution of the buckets.
+		auto pctile = [&](double frac) -> uint64_t {
+			uint64_t thresh = ceil(frac * st.count);
+			uint64_t sum = 0;
+			for (size_t b = 0; b < NBUCKETS; b++)
+			{
+				sum += st.hist[b];
+				if (thresh <= sum) return ((uint64_t) 1) << b;
+			}
+			return ((uint64_t) 1) << (NBUCKETS-1);
+		};
+
+		snprintf(buf, sizeof(buf), "%-24s %8lu %7lu %10.1f %6lu %6lu\n",
+			st.name.c_str(), st.count, st.errors,
+			1.0e-3 * st.nsecs / st.count, pctile(0.5), pctile(0.99));
+		rpt += buf;
+	}
+	return rpt;
+}
+
+/// Zero out the stats. The counters belong to the threads that bump
+/// them, and must not be written here; so instead, remember where
+/// they are now, and report only what happens after this.
+void Dispatcher::clear_stats(void)
+{
+	std::lock_guard<std::mutex> lck(_stats_mtx);
+	_baseline = sum_raw();
 }
 
 // ===================================================================
@@ -23,8 +23,13 @@
 #ifndef _DISPATCHER_H
 #define _DISPATCHER_H
 
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <opencog/persist/sexcom/Commands.h>
 
@@ -46,12 +51,84 @@ public:
 	// class of virtual methods.
 	typedef std::function<std::string (const std::string&)> Meth;
 
+	/// Methods that can hand back their reply in chunks.
+	typedef std::function<std::string (const std::string&,
+	                                   const Commands::Writer&)> StreamMeth;
+
 protected:
 	Commands _default;
 
 	/// Map to dispatch table
 	std::unordered_map<size_t, Meth> _dispatch_map;
 
+	/// Dispatch table for those commands that can stream their replies.
+	std::unordered_map<size_t, StreamMeth> _stream_map;
+
+	/// Dispatch table for the binary protocol, indexed by opcode.
+	std::vector<Meth> _binary_table;
+
+	/// Map from text command hash to the equivalent binary opcode.
+	std::unordered_map<size_t, uint8_t> _binary_ops;
+
+	size_t find_command(const std::string&, size_t&);
+
+	/// Performance instrumentation. Each thread keeps its own counters,
+	/// so that the hot path never takes a lock or bounces a cache line;
+	/// these are summed up only when a report is asked for. Latency
+	/// histograms have log2 buckets: bucket k counts commands that took
+	/// between 2^(k-1) and 2^k microseconds.
+	static constexpr size_t NBUCKETS = 24;
+	static constexpr size_t MAX_COMMANDS = 64;
+	struct CmdStats
+	{
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> errors;
+		std::atomic<uint64_t> nsecs;
+		std::atomic<uint64_t> hist[NBUCKETS];
+	};
+	struct ThreadStats
+	{
+		CmdStats cmds[MAX_COMMANDS];
+	};
+
+	/// Unique ID, so that per-thread stats are never confused with
+	/// those of a Dispatcher that previously lived at the same address.
+	size_t _id;
+
+	std::mutex _stats_mtx;
+	std::vector<std::shared_ptr<ThreadStats>> _thread_stats;
+
+	/// Stats accumulated by threads that have since exited.
+	std::shared_ptr<ThreadStats> _retired;
+	void add_stats(ThreadStats&, const ThreadStats&);
+
+	/// Map from command hash to a small index, and back to the name.
+	std::unordered_map<size_t, size_t> _cmd_index;
+	std::vector<std::string> _cmd_names;
+
+	/// Map from binary opcode to command index.
+	std::vector<size_t> _binary_index;
+
+	struct StatsTotal
+	{
+		std::string name;
+		uint64_t count = 0;
+		uint64_t errors = 0;
+		uint64_t nsecs = 0;
+		std::vector<uint64_t> hist;
+	};
+	std::vector<StatsTotal> sum_stats(void);
+	std::vector<StatsTotal> sum_raw(void);
+
+	/// The totals as of the last clear_stats(). The counters themselves
+	/// are never zeroed, as only the owning thread may write them;
+	/// instead, the reports subtract this baseline.
+	std::vector<StatsTotal> _baseline;
+
+	void register_command(size_t, const std::string&);
+	ThreadStats* get_thread_stats(void);
+	void record(size_t, const std::chrono::steady_clock::time_point&, bool);
+
 public:
 	Dispatcher(void);
 	~Dispatcher();
@@ -60,6 +137,9 @@ public:
 	void set_base_space(const AtomSpacePtr& asp) {
 		_default.set_base_space(asp); }
 
+	// Number of Atoms per chunk, for streamed replies.
+	void set_chunk_size(size_t sz) { _default.set_chunk_size(sz); }
+
 	/// Interpret a very small subset of singular scheme commands.
 	/// This is an ultra-minimalistic command interpreter. It only
 	/// supports those commands needed for network I/O of AtomSpace
@@ -91,6 +171,9 @@ public:
 	///
 	///    ping
 	///    cog-version
+	///    cog-protocol
+	///    cog-frame-ids
+	///    cog-stats
 	///
 	/// They MUST appear only once in the string, at the very beginning,
 	/// and they MUST be followed by valid Atomese s-expressions, and
@@ -98,11 +181,47 @@ public:
 	///
 	std::string interpret_command(const std::string&);
 
+	/// Same as above, except that commands that might return a very
+	/// large number of Atoms (`cog-get-atoms`, `cog-incoming-set` and
+	/// `cog-incoming-by-type`) pass their reply to the Writer in chunks,
+	/// instead of building one giant string. The tail end of the reply
+	/// is returned. Other commands behave exactly as above.
+	std::string interpret_command(const std::string&,
+	                              const Commands::Writer&);
+
+	/// Interpret one frame of the binary protocol. The argument is the
+	/// frame payload (without the length prefix): an opcode, followed by
+	/// the binary-encoded arguments. The returned string is a complete,
+	/// length-prefixed reply frame, or is empty, if the command has no
+	/// reply (just as in the text protocol.) Errors are returned as
+	/// error frames, and are not thrown. See `Binary.h` for details.
+	std::string interpret_binary(const std::string&);
+
+	/// Return true if `cmd` was a successful `cog-protocol` request,
+	/// i.e. if `reply` indicates that the caller has agreed to switch
+	/// to the binary protocol.
+	static bool is_protocol_switch(const std::string& cmd,
+	                               const std::string& reply);
+
 	/// Install a callback handler, over-riding the default behavior for
 	/// the command interpreter. This allows proxy agents to over-ride the
 	/// default interpretation of any message that is received, so as to do
 	/// ... something different. Anything different.
+	///
+	/// Over-ridden commands are not available in binary form; binary
+	/// requests for them are answered with an error frame, and should
+	/// be re-sent as text (using the BIN_TEXT opcode).
 	void install_handler(const std::string&, Meth);
+
+	/// Return performance stats for each command, as an s-expression.
+	/// This is the `(cog-stats)` command.
+	std::string cog_stats(const std::string&);
+
+	/// Return performance stats in human-readable form.
+	std::string monitor(void);
+
+	/// Zero out all of the stats.
+	void clear_stats(void);
 };
 
 /** @}*/
@@ -21,11 +21,12 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <algorithm>
 #include <chrono>
-#include <thread>
 
 #include <opencog/util/Logger.h>
 #include <opencog/atomspace/AtomSpace.h>
+#include <opencog/persist/sexcom/Binary.h>
 #include <opencog/persist/sexcom/Dispatcher.h>
 
 #include "SexprEval.h"
@@ -36,7 +37,8 @@ using namespace opencog;
 Dispatcher SexprEval::_interpreter;
 
 SexprEval::SexprEval(const AtomSpacePtr& asp)
-	: GenericEval()
+	: GenericEval(), _evaluating(false), _max_pending(MAX_PENDING),
+	  _poller(false), _binary(false), _escaped(false)
 {
 	_atomspace = asp;
 	_interpreter.set_base_space(asp);
@@ -53,16 +55,43 @@ SexprEval::~SexprEval()
 void SexprEval::eval_expr(const std::string &expr)
 {
 	_caught_error = false;
-	try {
+
+	if (_binary)
+	{
+		eval_binary(expr);
+		return;
+	}
+
+	// Replies to commands such as `cog-get-atoms` can be huge. These
+	// are handed over in chunks, so that poll_result() can ship them
+	// out while the remainder of the reply is still being generated.
+	bool wrote = false;
+	bool switch_proto = false;
+	auto writer = [&](const std::string& chunk)
+	{
+		if (chunk.empty()) return;
+		std::unique_lock<std::mutex> lock(_mtx);
+
+		// Don't let a huge reply run too far ahead of the reader,
+		// if there is one.
+		if (_poller)
+			_drained.wait_for(lock, std::chrono::seconds(60),
+				[this]{ return _answer.size() < _max_pending; });
+		_answer += chunk;
+		wrote = true;
+		_chunk_ready.notify_all();
+	};
+
+	{
 		std::lock_guard<std::mutex> lock(_mtx);
-		_answer = _interpreter.interpret_command(expr);
-
-		// CogStorageNode expects all responses to be terminated
-		// by exactly one newline char. It is the end-of-message
-		// marker. Empty responses have no newline - the client
-		// should not call recv() for commands that return nothing.
-		if (not _answer.empty())
-			_answer += "\n";
+		_evaluating = true;
+		_poller = false;
+	}
+
+	try {
+		std::string tail = _interpreter.interpret_command(expr, writer);
+		switch_proto = Dispatcher::is_protocol_switch(expr, tail);
+		writer(tail);
 	}
 	catch (const StandardException& ex)
 	{
@@ -74,52 +103,112 @@ void SexprEval::eval_expr(const std::string &expr)
 		_error_string = ex.what();
 		_caught_error = true;
 	}
+
+	std::lock_guard<std::mutex> lock(_mtx);
+
+	// If part of a streamed list went out before the failure, the
+	// reader is in the middle of parsing it. Do not close the list;
+	// the part that was sent would then look like the whole answer.
+	// Instead, end it with the same `ERROR:` text that the guile shell
+	// uses. That is not an Atom, so an s-expression reader fails on
+	// it. Newlines are removed, to keep the one-newline framing.
+	if (wrote and _caught_error)
+	{
+		std::string msg = _error_string;
+		std::replace_if(msg.begin(), msg.end(),
+			[](char c) { return '\n' == c or '\r' == c; }, ' ');
+		_answer += " ERROR: " + msg;
+	}
+
+	// CogStorageNode expects all responses to be terminated
+	// by exactly one newline char. It is the end-of-message
+	// marker. Empty responses have no newline - the client
+	// should not call recv() for commands that return nothing.
+	if (wrote)
+		_answer += "\n";
+	_evaluating = false;
+
+	// The acknowledgement was sent as text; everything after it
+	// is binary.
+	if (switch_proto) _binary = true;
+	_chunk_ready.notify_all();
+}
+
+/**
+ * Evaluate binary frames. These arrive escaped, one per line (see
+ * `Binary::encode_line()`), because the shell is line-oriented. Frames
+ * may be split across calls, or several may arrive at once; each
+ * complete frame is interpreted, and the partial remainder is held
+ * until the rest arrives. Each reply frame goes back as one line.
+ */
+void SexprEval::eval_binary(const std::string& data)
+{
+	std::string replies;
+	try
+	{
+		Binary::decode_line(_pending, data, _escaped);
+
+		size_t pos = 0;
+		std::string payload;
+		while (Binary::decode_frame(_pending, pos, payload))
+		{
+			std::string frame = _interpreter.interpret_binary(payload);
+			if (not frame.empty())
+				Binary::encode_line(replies, frame);
+		}
+		_pending.erase(0, pos);
+	}
+	catch (const StandardException& ex)
+	{
+		// A corrupt length prefix or escape; there's no way to resync.
+		_error_string = ex.what();
+		_caught_error = true;
+		_pending.clear();
+		_escaped = false;
+	}
+
+	std::lock_guard<std::mutex> lock(_mtx);
+	_answer += replies;
+	_chunk_ready.notify_all();
 }
 
 std::string SexprEval::poll_result()
 {
 	std::string ret;
-	std::lock_guard<std::mutex> lock(_mtx);
+	std::unique_lock<std::mutex> lock(_mtx);
+	if (_evaluating) _poller = true;
+
+	// If a reply is being streamed, wait for the next chunk. An empty
+	// return means that the reply is complete.
+	_chunk_ready.wait(lock,
+		[this]{ return not _answer.empty() or not _evaluating; });
 	ret.swap(_answer);
+	_drained.notify_all();
 	return ret;
 }
 
+/// Replies are queued up in the order in which the commands arrive,
+/// so a new command can be started before the replies to the earlier
+/// ones have been collected: commands from one connection pipeline.
+/// The only reason to wait is if the reader has fallen far behind;
+/// then wait for it to catch up, rather than buffering without bound.
+/// This waits on a condition variable; it never spins.
 void SexprEval::begin_eval()
 {
 	std::unique_lock<std::mutex> lock(_mtx);
-	if (_answer.empty()) return;
-
-	// Unusual race condition: some other thread is using this evaluator,
-	// and evaluation there has not completed. This seems to be rare,
-	// and I think we can just ignore this, at least for a little while.
-	auto start = std::chrono::steady_clock::now();
-	bool warned = false;
-	while (not _answer.empty())
-	{
-		// Release lock and yield so poll_result() can clear _answer
-		lock.unlock();
-		std::this_thread::yield();
-		lock.lock();
-
-		auto elapsed = std::chrono::steady_clock::now() - start;
-		auto secs = std::chrono::duration_cast<std::chrono::seconds>(elapsed).count();
-
-		// Only warn if we've been waiting a long time (> 1 second)
-		if (not warned and secs >= 1)
-		{
-			logger().warn("SexprEval::begin_eval: Buffer not empty after 1 sec, size=%lu",
-				_answer.size());
-			warned = true;
-		}
-
-		// Give up after 60 seconds - don't clear, something is very wrong
-		if (secs >= 60)
-		{
-			logger().error("SexprEval::begin_eval: Giving up after 60 sec, size=%lu",
-				_answer.size());
-			return;
-		}
-	}
+	auto drained = [this]{ return _answer.size() < _max_pending; };
+	if (drained()) return;
+
+	if (_drained.wait_for(lock, std::chrono::seconds(1), drained))
+		return;
+	logger().warn("SexprEval::begin_eval: Reader stalled for 1 sec, size=%lu",
+		_answer.size());
+
+	// Give up after 60 seconds - don't clear, something is very wrong
+	if (_drained.wait_for(lock, std::chrono::seconds(59), drained))
+		return;
+	logger().error("SexprEval::begin_eval: Giving up after 60 sec, size=%lu",
+		_answer.size());
 }
 
 /* ============================================================== */
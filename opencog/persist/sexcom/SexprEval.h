@@ -23,6 +23,7 @@
 #ifndef _OPENCOG_SEXPR_EVAL_H
 #define _OPENCOG_SEXPR_EVAL_H
 
+#include <condition_variable>
 #include <mutex>
 #include <string>
 #include <opencog/atomspace/AtomSpace.h>
@@ -58,6 +59,32 @@ class SexprEval : public GenericEval
 		std::mutex _mtx;
 		std::string _answer;
 
+		// Long replies are streamed out in chunks. While that is
+		// happening, poll_result() waits for the next chunk to arrive.
+		std::condition_variable _chunk_ready;
+		bool _evaluating;
+
+		// Replies from pipelined commands queue up in _answer. If the
+		// reader falls this far behind, begin_eval() waits for it.
+		// A streamed reply waits too, but only if some other thread is
+		// polling while it is generated; a caller that polls only after
+		// eval_expr() returns would never drain it.
+		static constexpr size_t MAX_PENDING = 64 * 1024 * 1024;
+		size_t _max_pending;
+		bool _poller;
+		std::condition_variable _drained;
+
+		// Set after the peer has negotiated the binary protocol (with
+		// the `cog-protocol` command). After that, all input is escaped
+		// binary frames, which may arrive split across several
+		// eval_expr() calls; the unescaped, incomplete remainder is kept
+		// in _pending, and _escaped is set if the last byte seen was the
+		// escape character.
+		bool _binary;
+		std::string _pending;
+		bool _escaped;
+		void eval_binary(const std::string&);
+
 		SexprEval(const AtomSpacePtr&);
 	public:
 		virtual ~SexprEval();
@@ -69,6 +96,14 @@ class SexprEval : public GenericEval
 
 		virtual void interrupt(void);
 
+		bool is_binary(void) const { return _binary; }
+
+		/// Bytes of unread reply to hold, before waiting for the reader.
+		void set_max_pending(size_t sz) { _max_pending = sz; }
+
+		/// Per-command performance stats, shared by all threads.
+		static std::string monitor(void) { return _interpreter.monitor(); }
+
 		static SexprEval* get_evaluator(const AtomSpacePtr&);
 		static SexprEval* get_evaluator(AtomSpace* as) {
 			AtomSpacePtr asp(AtomSpaceCast(as));
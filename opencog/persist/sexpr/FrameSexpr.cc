@@ -151,7 +151,10 @@ static Handle find_frame(const std::string& name, const Handle& surf)
 ///
 /// The cache is used to skip parsing of long s-expressions, if the
 /// named AtomSpace is found in the cache. This assumes that all
-/// AtomSpaces have unique names.
+/// AtomSpaces have unique names. The cache is checked first, before
+/// either the subframes are decoded, or the surface DAG is searched;
+/// thus, for frames that have been seen before, the cost is constant,
+/// independent of the depth or size of the DAG.
 ///
 Handle Sexpr::decode_frame(const Handle& surface,
                            const std::string& sframe, size_t& pos,
@@ -161,6 +164,7 @@ Handle Sexpr::decode_frame(const Handle& surface,
 
 	// Skip past whitespace
 	pos = sframe.find_first_not_of(" \n\t", pos);
+	size_t fstart = pos;
 
 	// Increment pos by one to point just after the open-paren.
 	size_t vos = sframe.find_first_of(" \n\t", ++pos);
@@ -178,12 +182,30 @@ Handle Sexpr::decode_frame(const Handle& surface,
 	size_t r = sframe.size();
 	std::string name = get_node_name(sframe, vos, r, FRAME);
 
+	// If we've seen this one before, then we're done. Skip over the
+	// rest of the expression, without decoding it.
+	auto it = cache.find(name);
+	if (it != cache.end())
+	{
+		size_t l = fstart;
+		size_t e = sframe.size();
+		get_next_expr(sframe, l, e, 0);
+		pos = e + 1;
+		return it->second;
+	}
+
 	// If we were given a DAG to search, search it.
 	if (surface and 0 < surface->get_arity())
 	{
-		pos = sframe.find(')', r) + 1;
-		// Perform a lookup by name only. If found, then return it.
-		return find_frame(name, surface);
+		size_t l = fstart;
+		size_t e = sframe.size();
+		get_next_expr(sframe, l, e, 0);
+		pos = e + 1;
+
+		// Perform a lookup by name only. If found, then remember it.
+		Handle frm = find_frame(name, surface);
+		if (frm) cache.insert({name, frm});
+		return frm;
 	}
 
 	// Are there subframes? Loop over them.
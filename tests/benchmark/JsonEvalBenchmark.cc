@@ -0,0 +1,79 @@
+/*
+ * JsonEvalBenchmark.cc
+ * Throughput of the per-thread, per-AtomSpace JSON evaluators.
+ *
+ * Copyright (c) 2026 OpenCog Foundation
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/persist/json/JsonEval.h>
+
+using namespace opencog;
+
+// Usage: JsonEvalBenchmark [nthreads [nevals]]
+// Each thread creates `nevals` Atoms, spread over several AtomSpaces.
+// The throughput should grow with the number of cores.
+int main(int argc, char* argv[])
+{
+	const size_t NSPACES = 4;
+	size_t nthreads = std::thread::hardware_concurrency();
+	size_t nevals = 50000;
+	if (1 < argc) nthreads = atol(argv[1]);
+	if (2 < argc) nevals = atol(argv[2]);
+	if (0 == nthreads) nthreads = 1;
+
+	std::vector<AtomSpacePtr> spaces;
+	for (size_t i = 0; i < NSPACES; i++)
+		spaces.push_back(createAtomSpace());
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < nthreads; t++)
+	{
+		threads.push_back(std::thread([&, t]() {
+			for (size_t i = 0; i < nevals; i++)
+			{
+				const AtomSpacePtr& as = spaces[(t + i) % NSPACES];
+				JsonEval* ev = JsonEval::get_evaluator(as);
+				ev->begin_eval();
+				ev->eval_expr(
+					"AtomSpace.makeAtom({\"type\": \"Concept\", \"name\": \""
+					+ std::to_string(t) + "-" + std::to_string(i) + "\"})");
+				ev->poll_result();
+			}
+		}));
+	}
+	for (std::thread& thr : threads) thr.join();
+
+	std::chrono::duration<double> secs =
+		std::chrono::steady_clock::now() - start;
+	printf("JsonEval: threads: %zu evals: %zu in %g secs; %g evals/sec\n",
+		nthreads, nthreads * nevals, secs.count(),
+		nthreads * nevals / secs.count());
+	return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * WriteBufferBenchmark.cc
+ * Drain throughput of the WriteBufferProxy, as writers are added.
+ *
+ * Copyright (c) 2026 OpenCog Foundation
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/persist/storage/storage_types.h>
+#include <opencog/persist/file/FileStorage.h>
+#include <opencog/persist/proxy/ProxyNode.h>
+
+using namespace opencog;
+
+static AtomSpacePtr as;
+static Handle key;
+
+static void msg(const StorageNodePtr& stn, const char* pred, const ValuePtr& v)
+{
+	stn->setValue(as->add_node(PREDICATE_NODE, pred), v);
+}
+
+// Buffer all of the ListLinks and their Values, and return the
+// number of seconds taken to drain them to the target.
+static double drain(const Handle& target, size_t nwriters)
+{
+	using namespace std::chrono;
+
+	StorageNodePtr wb = StorageNodeCast(as->add_node(
+		WRITE_BUFFER_PROXY_NODE,
+		"buffer " + std::to_string(nwriters) + " " + target->get_name()));
+	msg(wb, "*-proxy-parts-*", target);
+	msg(wb, "*-drain-threads-*",
+		as->add_node(NUMBER_NODE, std::to_string(nwriters)));
+	msg(wb, "*-open-*", nullptr);
+
+	HandleSeq links;
+	as->get_handles_by_type(links, LIST_LINK);
+	for (const Handle& h : links)
+	{
+		wb->store_atom(h);
+		wb->store_value(h, key);
+	}
+
+	steady_clock::time_point start = steady_clock::now();
+	wb->barrier();
+	double secs = duration_cast<duration<double>>(
+		steady_clock::now() - start).count();
+
+	msg(wb, "*-close-*", nullptr);
+	return secs;
+}
+
+// Usage: WriteBufferBenchmark [natoms]
+// Each Atom is one ListLink with one Value, so there are two writes
+// per Atom. The NullProxy shows the overhead of the buffer itself.
+int main(int argc, char* argv[])
+{
+	size_t natoms = 100000;
+	if (1 < argc) natoms = atol(argv[1]);
+
+	opencog_persist_proxy_init();
+	as = createAtomSpace();
+	key = as->add_node(PREDICATE_NODE, "key");
+	for (size_t i = 0; i < natoms; i++)
+	{
+		Handle h = as->add_link(LIST_LINK,
+			as->add_node(CONCEPT_NODE, "node " + std::to_string(i)),
+			as->add_node(CONCEPT_NODE, "other " + std::to_string(i % 100)));
+		as->set_value(h, key, createFloatValue((double) i));
+	}
+
+	Handle null = as->add_node(NULL_PROXY_NODE, "null");
+	for (size_t nw : {1, 2, 4, 8})
+	{
+		double secs = drain(null, nw);
+		printf("NullProxy        writers=%zu  %8.0f writes/sec\n",
+			nw, 2.0 * natoms / secs);
+	}
+
+	std::string fname = "/tmp/write-buffer-bench-" +
+		std::to_string(getpid()) + ".scm";
+	for (size_t nw : {1, 2, 4, 8})
+	{
+		unlink(fname.c_str());
+		Handle fsn = as->add_atom(
+			createFileStorageNode(FILE_STORAGE_NODE, "file://" + fname));
+		double secs = drain(fsn, nw);
+		printf("FileStorageNode  writers=%zu  %8.0f writes/sec\n",
+			nw, 2.0 * natoms / secs);
+	}
+	unlink(fname.c_str());
+	return 0;
+}